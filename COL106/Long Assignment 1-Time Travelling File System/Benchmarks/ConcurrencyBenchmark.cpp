@@ -0,0 +1,63 @@
+#include "../File/FileSystem.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+
+using namespace std;
+
+// Runs the same mixed workload with 1, 2, 4, ... threads. Every thread works
+// on its own files, so throughput should scale until the shared rank and blob
+// locks become the bottleneck. Usage: concurrency_benchmark [ops_per_thread] [max_threads]
+
+static double elapsedMs(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+static void worker(FileSystem& fs, int thread_id, int ops) {
+    ostream null_out(nullptr);
+    vector<string> names;
+    for (int i = 0; i < 64; ++i) {
+        names.push_back("t" + to_string(thread_id) + "_f" + to_string(i));
+        fs.CREATE(names.back(), null_out, null_out);
+    }
+    for (int i = 0; i < ops; ++i) {
+        const string& name = names[i % names.size()];
+        int r = i % 10;
+        if (r < 4) {
+            fs.READ(name, null_out, null_out);
+        } else if (r < 7) {
+            fs.UPDATE(name, "line " + to_string(i) + " written by thread " + to_string(thread_id) + "\n", null_out, null_out);
+        } else if (r < 9) {
+            fs.SNAPSHOT(name, "s" + to_string(i), null_out, null_out);
+        } else {
+            fs.HISTORY(name, null_out, null_out);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int ops = argc > 1 ? atoi(argv[1]) : 50000;
+    int max_threads = argc > 2 ? atoi(argv[2]) : 8;
+
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        FileSystem fs;
+        fs.beginBatch();
+        auto start = chrono::steady_clock::now();
+        vector<thread> pool;
+        for (int t = 0; t < threads; ++t) {
+            pool.emplace_back(worker, ref(fs), t, ops);
+        }
+        for (thread& t : pool) {
+            t.join();
+        }
+        double ms = elapsedMs(start);
+        fs.endBatch();
+        long long total = static_cast<long long>(ops) * threads;
+        cout << threads << " thread(s): " << total << " ops in " << ms << " ms ("
+             << static_cast<long long>(total / (ms / 1000.0)) << " ops/sec)" << endl;
+    }
+    return 0;
+}
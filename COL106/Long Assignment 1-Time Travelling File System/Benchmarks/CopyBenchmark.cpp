@@ -0,0 +1,96 @@
+#include "../File/FileSystem.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <streambuf>
+
+using namespace std;
+
+// Measures how many bytes the READ, AS_OF READ, UPDATE and INSERT paths allocate
+// per call on one large file. Every copy of the content needs a buffer to land
+// in, so allocated bytes per op count the copies made on the way.
+// Usage: copy_benchmark [content_mb] [ops]
+
+static atomic<size_t> allocated_bytes(0);
+
+void* operator new(size_t size) {
+    allocated_bytes.fetch_add(size, memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (p == nullptr) {
+        throw bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+// Discards output, counting how much was written.
+class CountingBuffer : public streambuf {
+public:
+    size_t written = 0;
+
+protected:
+    int_type overflow(int_type c) override {
+        written++;
+        return c;
+    }
+    streamsize xsputn(const char*, streamsize n) override {
+        written += n;
+        return n;
+    }
+};
+
+static double elapsedMs(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+template <typename Op>
+static void measure(const char* name, int ops, size_t content_bytes, Op op) {
+    size_t before = allocated_bytes.load();
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < ops; ++i) {
+        op(i);
+    }
+    double ms = elapsedMs(start);
+    double per_op = static_cast<double>(allocated_bytes.load() - before) / ops;
+    cout << "  " << name << ": " << static_cast<long long>(per_op) << " bytes allocated per op ("
+         << per_op / content_bytes << "x the content), " << ms * 1000 / ops << " us/op" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    size_t content_mb = argc > 1 ? atoi(argv[1]) : 50;
+    int ops = argc > 2 ? atoi(argv[2]) : 20;
+    size_t content_bytes = content_mb << 20;
+
+    FileSystem fs;
+    CountingBuffer counter;
+    ostream sink(&counter);
+    ostream null_out(nullptr);
+    fs.CREATE("big", null_out, null_out);
+
+    // Payloads are built up front so that only the copies made by the file system are counted.
+    vector<string> payloads;
+    for (int i = 0; i < ops; ++i) {
+        payloads.push_back(string(content_bytes, static_cast<char>('a' + i % 26)));
+    }
+    cout << "Content of " << content_mb << " MB, " << ops << " ops per case:" << endl;
+
+    measure("UPDATE", ops, content_bytes, [&](int i) { fs.UPDATE("big", std::move(payloads[i]), null_out, null_out); });
+    measure("READ working version", ops, content_bytes, [&](int) { fs.READ("big", sink, null_out); });
+    measure("INSERT 16 bytes", ops, content_bytes, [&](int) { fs.INSERT("big", "0123456789abcdef", null_out, null_out); });
+    measure("READ after INSERT", ops, content_bytes, [&](int) { fs.READ("big", sink, null_out); });
+
+    fs.SNAPSHOT("big", "frozen", null_out, null_out);
+    Timestamp frozen_at = currentTimestamp();
+    measure("READ snapshot", ops, content_bytes, [&](int) { fs.READ("big", sink, null_out); });
+    fs.UPDATE("big", string("small"), null_out, null_out);
+    measure("AS_OF READ snapshot", ops, content_bytes, [&](int) { fs.AS_OF_READ(frozen_at, "big", sink, null_out); });
+
+    cout << "Wrote " << counter.written << " bytes of output" << endl;
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include "../File/File.hpp"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+
+using namespace std;
+
+// Builds a single file whose history is one linear INSERT+SNAPSHOT chain and
+// times the operations that walk or free it. Usage: deep_chain_benchmark [depth]
+
+static double elapsedMs(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    int depth = argc > 1 ? atoi(argv[1]) : 1000000;
+    BlobStore blobs;
+    File* file = new File("deep.log", 1, 0, &blobs);
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 1; i <= depth; ++i) {
+        file->INSERT("x", i);
+        file->SNAPSHOT("s", i);
+    }
+    cout << "Built chain of " << depth << " versions in " << elapsedMs(start) << " ms" << endl;
+
+    start = chrono::steady_clock::now();
+    string_view content;
+    file->READ(content);
+    size_t length = content.size();
+    cout << "READ active version (" << length << " bytes) in " << elapsedMs(start) << " ms" << endl;
+
+    file->ROLLBACK(depth / 2, depth + 1);
+    start = chrono::steady_clock::now();
+    file->READ(content);
+    length = content.size();
+    cout << "READ version " << depth / 2 << " (" << length << " bytes) in " << elapsedMs(start) << " ms" << endl;
+    file->ROLLBACK(depth, depth + 2);
+
+    stringstream sink;
+    streambuf* original = cout.rdbuf(sink.rdbuf());
+    start = chrono::steady_clock::now();
+    file->HISTORY();
+    double history_ms = elapsedMs(start);
+    cout.rdbuf(original);
+    cout << "HISTORY over " << depth + 1 << " snapshots in " << history_ms << " ms" << endl;
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < depth; ++i) {
+        file->ROLLBACK(-1, depth + 3 + i);
+    }
+    cout << "ROLLBACK to root one step at a time in " << elapsedMs(start) << " ms" << endl;
+
+    start = chrono::steady_clock::now();
+    delete file;
+    cout << "Teardown in " << elapsedMs(start) << " ms" << endl;
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include "../Server/Protocol.hpp"
+#include "../Server/Socket.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <unistd.h>
+
+using namespace std;
+
+// Drives a running `filesystem --serve` from several connections at once. Each
+// connection creates its own files, then keeps `depth` requests in flight (a
+// mix of READ, UPDATE, SNAPSHOT and HISTORY) until it has sent `requests` of
+// them. A request's latency runs from when it is written to when its response
+// has been read. Usage: load_generator <address> [connections] [requests] [depth]
+
+typedef chrono::steady_clock Clock;
+
+static mutex results_lock;
+static vector<double> latencies_us;
+static long long failed_connections = 0;
+
+static string requestFor(int connection_id, int i) {
+    string file = "lg" + to_string(connection_id) + "_f" + to_string(i % 16);
+    switch (i % 10) {
+        case 0: case 1: case 2: case 3:
+            return "READ " + file + "\n";
+        case 4: case 5: case 6:
+            return "UPDATE " + file + " request " + to_string(i) + " from connection " + to_string(connection_id) + "\n";
+        case 7: case 8:
+            return "SNAPSHOT " + file + " s" + to_string(i) + "\n";
+        default:
+            return "HISTORY " + file + "\n";
+    }
+}
+
+static void runConnection(const string& address, int connection_id, int requests, int depth) {
+    string error;
+    int fd = connectTo(address, error);
+    if (fd < 0) {
+        lock_guard<mutex> guard(results_lock);
+        cerr << "Error: " << error << "." << endl;
+        failed_connections++;
+        return;
+    }
+    ResponseParser parser;
+    Response response;
+    char chunk[1 << 16];
+    vector<double> latencies;
+    latencies.reserve(requests);
+
+    string setup;
+    for (int i = 0; i < 16; ++i) {
+        setup += "CREATE lg" + to_string(connection_id) + "_f" + to_string(i) + "\n";
+    }
+    sendAll(fd, setup.data(), setup.size());
+    for (int pending = 16; pending > 0;) {
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n <= 0) {
+            break;
+        }
+        parser.feed(chunk, n);
+        while (parser.next(response)) {
+            pending--;
+        }
+    }
+
+    deque<Clock::time_point> in_flight;
+    int sent = 0;
+    int received = 0;
+    string batch;
+    while (received < requests) {
+        batch.clear();
+        Clock::time_point now = Clock::now();
+        while (sent < requests && static_cast<int>(in_flight.size()) < depth) {
+            batch += requestFor(connection_id, sent++);
+            in_flight.push_back(now);
+        }
+        if (!batch.empty() && !sendAll(fd, batch.data(), batch.size())) {
+            break;
+        }
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n <= 0) {
+            break;
+        }
+        parser.feed(chunk, n);
+        now = Clock::now();
+        while (parser.next(response)) {
+            latencies.push_back(chrono::duration<double, micro>(now - in_flight.front()).count());
+            in_flight.pop_front();
+            received++;
+        }
+    }
+    close(fd);
+
+    lock_guard<mutex> guard(results_lock);
+    if (received < requests) {
+        cerr << "Error: Connection " << connection_id << " lost after " << received << " responses." << endl;
+        failed_connections++;
+    }
+    latencies_us.insert(latencies_us.end(), latencies.begin(), latencies.end());
+}
+
+static double percentile(const vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1));
+    return sorted[index];
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cerr << "Usage: " << argv[0] << " <address> [connections] [requests] [depth]" << endl;
+        return 1;
+    }
+    string address = argv[1];
+    int connections = argc > 2 ? atoi(argv[2]) : 4;
+    int requests = argc > 3 ? atoi(argv[3]) : 20000;
+    int depth = argc > 4 ? max(1, atoi(argv[4])) : 16;
+
+    auto start = Clock::now();
+    vector<thread> clients;
+    for (int c = 0; c < connections; ++c) {
+        clients.emplace_back(runConnection, address, c, requests, depth);
+    }
+    for (thread& client : clients) {
+        client.join();
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    sort(latencies_us.begin(), latencies_us.end());
+    cout << connections << " connection(s), pipeline depth " << depth << ": " << latencies_us.size()
+         << " requests in " << seconds << " s (" << static_cast<long long>(latencies_us.size() / seconds) << " requests/sec)" << endl;
+    cout << "Latency (us): p50 " << percentile(latencies_us, 0.50) << ", p90 " << percentile(latencies_us, 0.90)
+         << ", p99 " << percentile(latencies_us, 0.99) << ", max " << percentile(latencies_us, 1.0) << endl;
+    return failed_connections == 0 ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+#include "../File/LineDiff.hpp"
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+
+using namespace std;
+
+// Generates a base file of `lines` lines and two descendants that each edit a
+// disjoint set of lines (plus a few shared edits that conflict), then times the
+// three-way merge. Usage: merge_benchmark [lines] [edit_every]
+
+static double elapsedMs(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    int lines = argc > 1 ? atoi(argv[1]) : 200000;
+    int edit_every = argc > 2 ? atoi(argv[2]) : 50;
+    if (edit_every < 4) {
+        edit_every = 4;
+    }
+
+    string base, ours, theirs;
+    for (int i = 0; i < lines; ++i) {
+        string line = "line " + to_string(i) + " of the generated base file";
+        base += line + '\n';
+        if (i % edit_every == 0) {
+            ours += "ours edited " + to_string(i) + '\n';
+            theirs += line + '\n';
+        } else if (i % edit_every == edit_every / 2) {
+            ours += line + '\n';
+            theirs += "theirs edited " + to_string(i) + '\n';
+        } else if (i % (edit_every * 100) == 1) {
+            ours += "ours conflict " + to_string(i) + '\n';
+            theirs += "theirs conflict " + to_string(i) + '\n';
+        } else {
+            ours += line + '\n';
+            theirs += line + '\n';
+        }
+    }
+    cout << "Base " << lines << " lines (" << base.size() << " bytes), a change every "
+         << edit_every / 2 << " lines" << endl;
+
+    auto start = chrono::steady_clock::now();
+    MergeResult result = threeWayMerge(base, ours, theirs, "ours", "theirs");
+    cout << "Merged into " << result.content.size() << " bytes with " << result.conflicts
+         << " conflicts in " << elapsedMs(start) << " ms" << endl;
+
+    start = chrono::steady_clock::now();
+    result = threeWayMerge(base, base, theirs, "ours", "theirs");
+    cout << "One-sided merge in " << elapsedMs(start) << " ms" << endl;
+    return 0;
+}
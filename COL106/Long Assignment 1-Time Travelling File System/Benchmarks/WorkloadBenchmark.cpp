@@ -0,0 +1,208 @@
+#include "../File/FileSystem.hpp"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+// Synthetic workloads against FileSystem. Each one starts by creating its
+// files and then draws commands from its own mix, keeping a model of every
+// file's version tree so that ROLLBACK always targets a real snapshot. Every
+// command is timed on its own, and each workload runs in a child process so
+// the peak RSS reported is that workload's alone.
+// Usage: workload_benchmark [workload|all] [ops] [seed]
+
+enum BenchCommand {
+    B_CREATE, B_READ, B_INSERT, B_UPDATE, B_SNAPSHOT, B_ROLLBACK, B_HISTORY, B_RECENT_FILES, B_BIGGEST_TREES,
+    NUM_BENCH_COMMANDS
+};
+
+static const char* COMMAND_NAMES[NUM_BENCH_COMMANDS] = {
+    "CREATE", "READ", "INSERT", "UPDATE", "SNAPSHOT", "ROLLBACK", "HISTORY", "RECENT_FILES", "BIGGEST_TREES"
+};
+
+struct Workload {
+    const char* name;
+    const char* description;
+    int files;
+    int weights[NUM_BENCH_COMMANDS]; // per mille, CREATE excluded
+};
+
+static const Workload WORKLOADS[] = {
+    {"many_files", "20000 files with short histories", 20000, {0, 300, 250, 100, 200, 50, 100, 0, 0}},
+    {"deep_files", "4 files with very long snapshot chains", 4, {0, 99, 450, 0, 450, 0, 1, 0, 0}},
+    {"append_heavy", "1000 files, mostly INSERT", 1000, {0, 100, 800, 0, 100, 0, 0, 0, 0}},
+    {"update_heavy", "1000 files, mostly UPDATE", 1000, {0, 100, 0, 800, 100, 0, 0, 0, 0}},
+    {"branching", "200 files, ROLLBACK to random snapshots before editing", 200, {0, 100, 300, 0, 300, 300, 0, 0, 0}},
+    {"rankings", "2000 files with frequent RECENT_FILES/BIGGEST_TREES", 2000, {0, 0, 400, 200, 200, 0, 0, 100, 100}},
+};
+
+// Accepts and discards everything, so commands still format their output.
+class DiscardBuffer : public streambuf {
+protected:
+    int_type overflow(int_type c) override { return traits_type::not_eof(c); }
+    streamsize xsputn(const char*, streamsize n) override { return n; }
+};
+
+// What the generator knows about a file's version tree.
+struct FileModel {
+    string name;
+    int next_id;
+    int active;
+    bool active_is_snapshot;
+    vector<int> snapshots;
+};
+
+static double percentile(vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    return sorted[static_cast<size_t>(p * (sorted.size() - 1))];
+}
+
+static void runWorkload(const Workload& workload, long long ops, unsigned seed) {
+    DiscardBuffer discard;
+    ostream sink(&discard);
+    FileSystem fs;
+    mt19937 rng(seed);
+    vector<vector<double>> latencies(NUM_BENCH_COMMANDS);
+    vector<double> total_us(NUM_BENCH_COMMANDS, 0);
+
+    auto timed = [&](BenchCommand command, auto&& run) {
+        auto start = chrono::steady_clock::now();
+        run();
+        double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+        latencies[command].push_back(us);
+        total_us[command] += us;
+    };
+
+    vector<FileModel> files(workload.files);
+    for (int i = 0; i < workload.files; ++i) {
+        files[i] = FileModel{"file" + to_string(i), 1, 0, true, {0}};
+        timed(B_CREATE, [&] { fs.CREATE(files[i].name, sink, sink); });
+    }
+
+    vector<int> cumulative(NUM_BENCH_COMMANDS, 0);
+    int sum = 0;
+    for (int c = 0; c < NUM_BENCH_COMMANDS; ++c) {
+        sum += workload.weights[c];
+        cumulative[c] = sum;
+    }
+    vector<string> contents;
+    for (int i = 0; i < 64; ++i) {
+        contents.push_back("line " + to_string(i) + " of generated content, " + string(i % 48, 'x') + "\n");
+    }
+
+    auto start = chrono::steady_clock::now();
+    for (long long op = 0; op < ops; ++op) {
+        int pick = rng() % sum;
+        BenchCommand command = static_cast<BenchCommand>(upper_bound(cumulative.begin(), cumulative.end(), pick) - cumulative.begin());
+        FileModel& file = files[rng() % files.size()];
+        const string& content = contents[rng() % contents.size()];
+        switch (command) {
+            case B_READ:
+                timed(command, [&] { fs.READ(file.name, sink, sink); });
+                break;
+            case B_INSERT:
+            case B_UPDATE:
+                if (file.active_is_snapshot) {
+                    file.active = file.next_id++;
+                    file.active_is_snapshot = false;
+                }
+                if (command == B_INSERT) {
+                    timed(command, [&] { fs.INSERT(file.name, content, sink, sink); });
+                } else {
+                    timed(command, [&] { fs.UPDATE(file.name, content, sink, sink); });
+                }
+                break;
+            case B_SNAPSHOT:
+                if (!file.active_is_snapshot) {
+                    file.snapshots.push_back(file.active);
+                    file.active_is_snapshot = true;
+                }
+                timed(command, [&] { fs.SNAPSHOT(file.name, "snapshot " + to_string(op), sink, sink); });
+                break;
+            case B_ROLLBACK: {
+                int target = file.snapshots[rng() % file.snapshots.size()];
+                file.active = target;
+                file.active_is_snapshot = true;
+                timed(command, [&] { fs.ROLLBACK(file.name, target, sink, sink); });
+                break;
+            }
+            case B_HISTORY:
+                timed(command, [&] { fs.HISTORY(file.name, sink, sink); });
+                break;
+            case B_RECENT_FILES:
+                timed(command, [&] { fs.RECENT_FILES(10, sink); });
+                break;
+            case B_BIGGEST_TREES:
+                timed(command, [&] { fs.BIGGEST_TREES(10, sink); });
+                break;
+            default:
+                break;
+        }
+    }
+    double elapsed_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    cout << "Workload " << workload.name << " (" << workload.description << "): " << ops << " ops in "
+         << fixed << setprecision(1) << elapsed_ms << " ms (" << static_cast<long long>(ops / (elapsed_ms / 1000.0))
+         << " ops/sec), peak RSS " << usage.ru_maxrss / 1024.0 << " MB" << '\n';
+    cout << "  " << left << setw(14) << "command" << right << setw(10) << "count" << setw(12) << "ops/sec"
+         << setw(10) << "p50 us" << setw(10) << "p90 us" << setw(10) << "p99 us" << setw(10) << "max us" << '\n';
+    for (int c = 0; c < NUM_BENCH_COMMANDS; ++c) {
+        vector<double>& samples = latencies[c];
+        if (samples.empty()) {
+            continue;
+        }
+        sort(samples.begin(), samples.end());
+        cout << "  " << left << setw(14) << COMMAND_NAMES[c] << right << setw(10) << samples.size()
+             << setw(12) << static_cast<long long>(samples.size() / (total_us[c] / 1e6))
+             << setprecision(2) << setw(10) << percentile(samples, 0.50) << setw(10) << percentile(samples, 0.90)
+             << setw(10) << percentile(samples, 0.99) << setw(10) << samples.back() << '\n';
+    }
+    cout << flush;
+}
+
+int main(int argc, char* argv[]) {
+    string which = argc > 1 ? argv[1] : "all";
+    long long ops = argc > 2 ? atoll(argv[2]) : 200000;
+    unsigned seed = argc > 3 ? atoi(argv[3]) : 42;
+
+    bool found = false;
+    for (const Workload& workload : WORKLOADS) {
+        if (which != "all" && which != workload.name) {
+            continue;
+        }
+        found = true;
+        pid_t child = fork();
+        if (child == 0) {
+            runWorkload(workload, ops, seed);
+            _exit(0);
+        }
+        int status = 0;
+        waitpid(child, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            cerr << "Error: Workload " << workload.name << " failed." << endl;
+            return 1;
+        }
+    }
+    if (!found) {
+        cerr << "Usage: " << argv[0] << " [all";
+        for (const Workload& workload : WORKLOADS) {
+            cerr << "|" << workload.name;
+        }
+        cerr << "] [ops] [seed]" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include "BatchIO.hpp"
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+InputFile::InputFile() : data(nullptr), size(0), mapped(false) {}
+
+InputFile::~InputFile() {
+    if (mapped) {
+        munmap(const_cast<char*>(data), size);
+    }
+}
+
+bool InputFile::open(const string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+            close(fd);
+            data = static_cast<const char*>(mapping);
+            size = st.st_size;
+            mapped = true;
+            return true;
+        }
+    }
+    close(fd);
+    ifstream in(path, ios::binary);
+    if (!in) {
+        return false;
+    }
+    stringstream ss;
+    ss << in.rdbuf();
+    buffer = ss.str();
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+}
+
+string_view InputFile::contents() const {
+    return string_view(data, size);
+}
+
+FdOutputBuffer::FdOutputBuffer(int out_fd, size_t block_size) : fd(out_fd) {
+    block.reserve(block_size);
+}
+
+FdOutputBuffer::~FdOutputBuffer() {
+    drain();
+}
+
+static bool writeAll(int fd, const char* data, size_t size) {
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = write(fd, data + written, size - written);
+        if (n < 0) {
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+bool FdOutputBuffer::drain() {
+    bool ok = writeAll(fd, block.data(), block.size());
+    block.clear();
+    return ok;
+}
+
+FdOutputBuffer::int_type FdOutputBuffer::overflow(int_type c) {
+    if (traits_type::eq_int_type(c, traits_type::eof())) {
+        return traits_type::not_eof(c);
+    }
+    if (block.size() == block.capacity() && !drain()) {
+        return traits_type::eof();
+    }
+    block.push_back(traits_type::to_char_type(c));
+    return c;
+}
+
+streamsize FdOutputBuffer::xsputn(const char* s, streamsize n) {
+    if (block.size() + n > block.capacity()) {
+        if (!drain()) {
+            return 0;
+        }
+        if (static_cast<size_t>(n) > block.capacity()) {
+            return writeAll(fd, s, n) ? n : 0;
+        }
+    }
+    block.append(s, n);
+    return n;
+}
+
+int FdOutputBuffer::sync() {
+    return drain() ? 0 : -1;
+}
@@ -0,0 +1,49 @@
+#ifndef BATCHIO_HPP
+#define BATCHIO_HPP
+
+#include <string>
+#include <string_view>
+#include <streambuf>
+
+using namespace std;
+
+// Read-only view of a whole input file. Regular files are mmap'd; anything that
+// cannot be mapped (pipes, empty files) is read into memory instead.
+class InputFile {
+private:
+    const char* data;
+    size_t size;
+    bool mapped;
+    string buffer;
+
+public:
+    InputFile();
+    ~InputFile();
+    InputFile(const InputFile&) = delete;
+    InputFile& operator=(const InputFile&) = delete;
+
+    bool open(const string& path);
+    string_view contents() const;
+};
+
+// Output stream buffer that collects writes in one large block and hands it to
+// a file descriptor only when the block is full or on flush, instead of once per
+// line.
+class FdOutputBuffer : public streambuf {
+private:
+    int fd;
+    string block;
+
+    bool drain();
+
+protected:
+    int_type overflow(int_type c) override;
+    streamsize xsputn(const char* s, streamsize n) override;
+    int sync() override;
+
+public:
+    FdOutputBuffer(int out_fd, size_t block_size = 1 << 20);
+    ~FdOutputBuffer();
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include "CommandRunner.hpp"
+#include "CommandTokenizer.hpp"
+#include <string>
+
+using namespace std;
+
+void runCommand(FileSystem& fs, string_view line, ostream& out, ostream& err) {
+    CommandTokenizer tok(line);
+    string_view command;
+    tok.next(command);
+
+    if (command == "CREATE") {
+        string filename;
+        if (tok.next(filename)) fs.CREATE(filename, out, err);
+        else err << "Usage: CREATE <filename>" << endl;
+    } else if (command == "READ") {
+        string filename;
+        if (tok.next(filename)) fs.READ(filename, out, err);
+        else err << "Usage: READ <filename>" << endl;
+    } else if (command == "INSERT") {
+        string filename;
+        if (tok.next(filename)) {
+            fs.INSERT(filename, tok.rest(), out, err);
+        } else {
+            err << "Usage: INSERT <filename> <content>" << endl;
+        }
+    } else if (command == "UPDATE") {
+        string filename;
+        if (tok.next(filename)) {
+            fs.UPDATE(filename, tok.rest(), out, err);
+        } else {
+            err << "Usage: UPDATE <filename> <content>" << endl;
+        }
+    } else if (command == "SNAPSHOT") {
+        string filename;
+        if (tok.next(filename)) {
+            string message = tok.rest();
+            fs.SNAPSHOT(filename, message, out, err);
+        } else {
+            err << "Usage: SNAPSHOT <filename> <message>" << endl;
+        }
+    } else if (command == "ROLLBACK") {
+        string filename;
+        if (tok.next(filename)) {
+            int versionID;
+            if (tok.nextInt(versionID)) fs.ROLLBACK(filename, versionID, out, err);
+            else fs.ROLLBACK(filename, -1, out, err);
+        } else {
+            err << "Usage: ROLLBACK <filename>[versionID]" << endl;
+        }
+    } else if (command == "HISTORY") {
+        string filename;
+        if (tok.next(filename)) fs.HISTORY(filename, out, err);
+        else err << "Usage: HISTORY <filename>" << endl;
+    } else if (command == "DIFF") {
+        string filename;
+        int versionA, versionB;
+        if (tok.next(filename) && tok.nextInt(versionA) && tok.nextInt(versionB)) fs.DIFF(filename, versionA, versionB, out, err);
+        else err << "Usage: DIFF <filename> <versionID> <versionID>" << endl;
+    } else if (command == "MERGE") {
+        string filename;
+        int versionA, versionB;
+        if (tok.next(filename) && tok.nextInt(versionA) && tok.nextInt(versionB)) fs.MERGE(filename, versionA, versionB, out, err);
+        else err << "Usage: MERGE <filename> <versionID> <versionID>" << endl;
+    } else if (command == "TAG") {
+        string filename;
+        int versionID;
+        if (tok.next(filename) && tok.nextInt(versionID)) fs.TAG(filename, versionID, out, err);
+        else err << "Usage: TAG <filename> <versionID>" << endl;
+    } else if (command == "AS_OF") {
+        string_view when, subcommand;
+        string filename;
+        Timestamp t;
+        if (tok.next(when) && parseTimestamp(when, t) && tok.next(subcommand) && subcommand == "READ" && tok.next(filename)) {
+            fs.AS_OF_READ(t, filename, out, err);
+        } else {
+            err << "Usage: AS_OF <timestamp> READ <filename>" << endl;
+        }
+    } else if (command == "CHANGED_BETWEEN") {
+        string_view from, to;
+        Timestamp t1, t2;
+        if (tok.next(from) && parseTimestamp(from, t1) && tok.next(to) && parseTimestamp(to, t2)) {
+            fs.CHANGED_BETWEEN(t1, t2, out, err);
+        } else {
+            err << "Usage: CHANGED_BETWEEN <timestamp> <timestamp>" << endl;
+        }
+    } else if (command == "GC") {
+        int keep_last;
+        if (tok.nextInt(keep_last)) {
+            if (keep_last >= -1) fs.GC(keep_last, out);
+            else err << "Usage: GC [keep_last]" << endl;
+        } else {
+            fs.GC(-1, out);
+        }
+    } else if (command == "RECENT_FILES") {
+        int num;
+        if (tok.nextInt(num)) fs.RECENT_FILES(num, out);
+        else fs.RECENT_FILES(-1, out);
+    } else if (command == "BIGGEST_TREES") {
+        int num;
+        if (tok.nextInt(num)) fs.BIGGEST_TREES(num, out);
+        else fs.BIGGEST_TREES(-1, out);
+    } else if (command == "BLOB_STATS") {
+        fs.BLOB_STATS(out);
+    } else if (command == "CHECKPOINT") {
+        fs.CHECKPOINT(out, err);
+    } else if (command == "SEARCH") {
+        string_view scope;
+        string query;
+        if (tok.next(scope) && (scope == "ACTIVE" || scope == "ALL") && !(query = tok.rest()).empty()) {
+            fs.SEARCH(scope == "ALL", query, out, err);
+        } else {
+            err << "Usage: SEARCH ACTIVE|ALL <word> [word...]" << endl;
+        }
+    } else if (command == "LS") {
+        string prefix;
+        int limit;
+        if (!tok.next(prefix)) fs.LS("", -1, out);
+        else if (!tok.nextInt(limit)) fs.LS(prefix, -1, out);
+        else if (limit >= 0) fs.LS(prefix, limit, out);
+        else err << "Usage: LS [prefix] [limit]" << endl;
+    } else if (command == "STATS") {
+        string_view format;
+        if (!tok.next(format)) fs.STATS(false, out, err);
+        else if (format == "json") fs.STATS(true, out, err);
+        else err << "Usage: STATS [json]" << endl;
+    } else if (!command.empty()) {
+        err << "Error: Unknown command '" << command << "'." << endl;
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef COMMANDRUNNER_HPP
+#define COMMANDRUNNER_HPP
+
+#include "../File/FileSystem.hpp"
+#include <iostream>
+#include <string_view>
+
+using namespace std;
+
+// Parses one command line and runs it against `fs`. Command output goes to
+// `out`, usage and error messages to `err`.
+void runCommand(FileSystem& fs, string_view line, ostream& out = cout, ostream& err = cerr);
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef COMMANDTOKENIZER_HPP
+#define COMMANDTOKENIZER_HPP
+
+#include <string>
+#include <string_view>
+#include <climits>
+
+using namespace std;
+
+// Splits one command line into whitespace-separated tokens. Tokens are views
+// into the line, so nothing is copied until a caller needs an owned string.
+class CommandTokenizer {
+private:
+    string_view line;
+    size_t pos;
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    void skipSpace() {
+        while (pos < line.size() && isSpace(line[pos])) {
+            pos++;
+        }
+    }
+
+public:
+    explicit CommandTokenizer(string_view text) : line(text), pos(0) {}
+
+    bool next(string_view& token) {
+        skipSpace();
+        size_t start = pos;
+        while (pos < line.size() && !isSpace(line[pos])) {
+            pos++;
+        }
+        token = line.substr(start, pos - start);
+        return pos > start;
+    }
+
+    bool next(string& token) {
+        string_view view;
+        if (!next(view)) {
+            return false;
+        }
+        token.assign(view.data(), view.size());
+        return true;
+    }
+
+    // Reads a leading integer the way `stream >> int` does: an optional sign and
+    // at least one digit, failing on overflow. Anything after the digits is dropped.
+    bool nextInt(int& value) {
+        string_view token;
+        if (!next(token)) {
+            return false;
+        }
+        size_t i = 0;
+        bool negative = false;
+        if (token[0] == '+' || token[0] == '-') {
+            negative = token[0] == '-';
+            i++;
+        }
+        if (i == token.size() || token[i] < '0' || token[i] > '9') {
+            return false;
+        }
+        long long result = 0;
+        for (; i < token.size() && token[i] >= '0' && token[i] <= '9'; ++i) {
+            result = result * 10 + (token[i] - '0');
+            if (result > static_cast<long long>(INT_MAX) + 1) {
+                return false;
+            }
+        }
+        result = negative ? -result : result;
+        if (result > INT_MAX || result < INT_MIN) {
+            return false;
+        }
+        value = static_cast<int>(result);
+        return true;
+    }
+
+    // The remaining tokens joined by single spaces.
+    string rest() {
+        string joined;
+        string_view token;
+        while (next(token)) {
+            if (!joined.empty()) {
+                joined += ' ';
+            }
+            joined.append(token.data(), token.size());
+        }
+        return joined;
+    }
+};
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <vector>
+#include <string_view>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+using namespace std;
+
+// Bump allocator. Memory is carved out of blocks that start small and double up
+// to max_block_size, and is only returned when the arena itself is destroyed.
+// Objects created in an arena are not destroyed by it; owners that need their
+// destructors run must call them before the arena goes away.
+class Arena {
+private:
+    vector<char*> blocks;
+    char* cursor;
+    size_t remaining;
+    size_t next_block_size;
+    size_t max_block_size;
+    size_t bytes_reserved;
+
+    void addBlock(size_t min_size) {
+        size_t size = next_block_size;
+        while (size < min_size) {
+            size *= 2;
+        }
+        if (next_block_size < max_block_size) {
+            next_block_size *= 2;
+        }
+        char* block = static_cast<char*>(malloc(size));
+        if (block == nullptr) {
+            throw bad_alloc();
+        }
+        blocks.push_back(block);
+        cursor = block;
+        remaining = size;
+        bytes_reserved += size;
+    }
+
+public:
+    Arena(size_t first_block_size = 1024, size_t max_block = 64 * 1024)
+        : cursor(nullptr), remaining(0), next_block_size(first_block_size),
+          max_block_size(max_block), bytes_reserved(0) {}
+
+    ~Arena() {
+        for (char* block : blocks) {
+            free(block);
+        }
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align = alignof(max_align_t)) {
+        size_t padding = (align - reinterpret_cast<size_t>(cursor) % align) % align;
+        if (cursor == nullptr || padding + size > remaining) {
+            addBlock(size + align);
+            padding = (align - reinterpret_cast<size_t>(cursor) % align) % align;
+        }
+        char* result = cursor + padding;
+        cursor += padding + size;
+        remaining -= padding + size;
+        return result;
+    }
+
+    template <typename T, typename... Args>
+    T* create(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    string_view copyString(string_view s) {
+        if (s.empty()) {
+            return string_view();
+        }
+        char* data = static_cast<char*>(allocate(s.size(), 1));
+        memcpy(data, s.data(), s.size());
+        return string_view(data, s.size());
+    }
+
+    size_t bytesReserved() const {
+        return bytes_reserved;
+    }
+};
+
+#endif
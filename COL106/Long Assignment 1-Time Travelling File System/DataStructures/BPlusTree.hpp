@@ -0,0 +1,191 @@
+#ifndef BPLUSTREE_HPP
+#define BPLUSTREE_HPP
+
+#include <algorithm>
+
+using namespace std;
+
+// Ordered map kept as a B+-tree: inner nodes hold only separator keys, and the
+// entries sit in leaves chained left to right, so a range scan is one descent
+// followed by a walk along the leaves. Nodes hold up to ORDER keys in flat
+// arrays, which keeps a descent to a handful of cache-friendly binary searches.
+// Entries are never removed.
+template <typename K, typename V, int ORDER = 64>
+class BPlusTree {
+private:
+    struct Node {
+        bool leaf;
+        int count; // keys in use
+        K keys[ORDER];
+        explicit Node(bool is_leaf) : leaf(is_leaf), count(0) {}
+    };
+
+    struct Leaf : Node {
+        V vals[ORDER];
+        Leaf* next;
+        Leaf() : Node(true), next(nullptr) {}
+    };
+
+    // children[i] holds the keys below keys[i]; children[count] the rest.
+    struct Inner : Node {
+        Node* children[ORDER + 1];
+        Inner() : Node(false) {}
+    };
+
+    Node* root;
+    int num_entries;
+
+    // First slot whose key is not less than `key`.
+    static int lowerBound(const Node* node, const K& key) {
+        return lower_bound(node->keys, node->keys + node->count, key) - node->keys;
+    }
+
+    // Child of an inner node that `key` belongs under.
+    static int childIndex(const Inner* node, const K& key) {
+        return upper_bound(node->keys, node->keys + node->count, key) - node->keys;
+    }
+
+    // Inserts into the subtree at `node`. If the node had to split, returns the
+    // new right sibling and sets `separator` to its smallest key.
+    Node* insertInto(Node* node, const K& key, const V& val, K& separator, bool& inserted) {
+        if (node->leaf) {
+            Leaf* leaf = static_cast<Leaf*>(node);
+            int i = lowerBound(leaf, key);
+            if (i < leaf->count && !(key < leaf->keys[i])) {
+                inserted = false;
+                return nullptr;
+            }
+            inserted = true;
+            if (leaf->count < ORDER) {
+                insertAt(leaf, i, key, val);
+                return nullptr;
+            }
+            Leaf* right = new Leaf();
+            int half = ORDER / 2;
+            move(leaf->keys + half, leaf->keys + ORDER, right->keys);
+            move(leaf->vals + half, leaf->vals + ORDER, right->vals);
+            right->count = ORDER - half;
+            leaf->count = half;
+            right->next = leaf->next;
+            leaf->next = right;
+            if (i <= half) {
+                insertAt(leaf, i, key, val);
+            } else {
+                insertAt(right, i - half, key, val);
+            }
+            separator = right->keys[0];
+            return right;
+        }
+
+        Inner* inner = static_cast<Inner*>(node);
+        int c = childIndex(inner, key);
+        K child_separator;
+        Node* split = insertInto(inner->children[c], key, val, child_separator, inserted);
+        if (split == nullptr) {
+            return nullptr;
+        }
+        if (inner->count < ORDER) {
+            insertChild(inner, c, child_separator, split);
+            return nullptr;
+        }
+        // Split around the middle key, which moves up instead of staying in either half.
+        Inner* right = new Inner();
+        int half = ORDER / 2;
+        K keys[ORDER + 1];
+        Node* children[ORDER + 2];
+        move(inner->keys, inner->keys + c, keys);
+        keys[c] = child_separator;
+        move(inner->keys + c, inner->keys + ORDER, keys + c + 1);
+        copy(inner->children, inner->children + c + 1, children);
+        children[c + 1] = split;
+        copy(inner->children + c + 1, inner->children + ORDER + 1, children + c + 2);
+
+        inner->count = half;
+        move(keys, keys + half, inner->keys);
+        copy(children, children + half + 1, inner->children);
+        separator = keys[half];
+        right->count = ORDER - half;
+        move(keys + half + 1, keys + ORDER + 1, right->keys);
+        copy(children + half + 1, children + ORDER + 2, right->children);
+        return right;
+    }
+
+    static void insertAt(Leaf* leaf, int i, const K& key, const V& val) {
+        move_backward(leaf->keys + i, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+        move_backward(leaf->vals + i, leaf->vals + leaf->count, leaf->vals + leaf->count + 1);
+        leaf->keys[i] = key;
+        leaf->vals[i] = val;
+        leaf->count++;
+    }
+
+    static void insertChild(Inner* inner, int c, const K& key, Node* child) {
+        move_backward(inner->keys + c, inner->keys + inner->count, inner->keys + inner->count + 1);
+        copy_backward(inner->children + c + 1, inner->children + inner->count + 1, inner->children + inner->count + 2);
+        inner->keys[c] = key;
+        inner->children[c + 1] = child;
+        inner->count++;
+    }
+
+    static void destroy(Node* node) {
+        if (node->leaf) {
+            delete static_cast<Leaf*>(node);
+            return;
+        }
+        Inner* inner = static_cast<Inner*>(node);
+        for (int i = 0; i <= inner->count; ++i) {
+            destroy(inner->children[i]);
+        }
+        delete inner;
+    }
+
+public:
+    BPlusTree() : root(new Leaf()), num_entries(0) {}
+    ~BPlusTree() { destroy(root); }
+    BPlusTree(const BPlusTree&) = delete;
+    BPlusTree& operator=(const BPlusTree&) = delete;
+
+    // Returns false, leaving the tree unchanged, if the key is already present.
+    bool INSERT(const K& key, const V& val) {
+        K separator;
+        bool inserted = false;
+        Node* split = insertInto(root, key, val, separator, inserted);
+        if (split != nullptr) {
+            Inner* new_root = new Inner();
+            new_root->count = 1;
+            new_root->keys[0] = separator;
+            new_root->children[0] = root;
+            new_root->children[1] = split;
+            root = new_root;
+        }
+        num_entries += inserted;
+        return inserted;
+    }
+
+    // Calls visit(key, val) for the entries from the first key not less than
+    // `from` onwards, in order, until visit returns false.
+    template <typename Visitor>
+    void scanFrom(const K& from, Visitor visit) const {
+        const Node* node = root;
+        while (!node->leaf) {
+            const Inner* inner = static_cast<const Inner*>(node);
+            node = inner->children[childIndex(inner, from)];
+        }
+        const Leaf* leaf = static_cast<const Leaf*>(node);
+        int i = lowerBound(leaf, from);
+        while (leaf != nullptr) {
+            for (; i < leaf->count; ++i) {
+                if (!visit(leaf->keys[i], leaf->vals[i])) {
+                    return;
+                }
+            }
+            leaf = leaf->next;
+            i = 0;
+        }
+    }
+
+    int size() const {
+        return num_entries;
+    }
+};
+
+#endif
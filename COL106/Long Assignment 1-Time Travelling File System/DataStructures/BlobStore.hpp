@@ -0,0 +1,241 @@
+#ifndef BLOBSTORE_HPP
+#define BLOBSTORE_HPP
+
+#include "HashMap.hpp"
+#include "LzCodec.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+
+using namespace std;
+
+const uint64_t CONTENT_HASH_SEED = 14695981039346656037ULL;
+
+// 64-bit FNV-1a. Passing the hash of a prefix as `seed` continues the hash, so
+// the hash of parent content + appended text can be computed from the appended text alone.
+inline uint64_t contentHash(string_view data, uint64_t seed = CONTENT_HASH_SEED) {
+    uint64_t hash = seed;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Immutable, reference-counted buffer shared by every version holding the same
+// bytes. Cold blobs can be compressed in place; read them through BlobStore::appendTo.
+struct Blob {
+    string data;     // the bytes, LZ-compressed if `compressed`
+    size_t size;     // uncompressed size
+    bool compressed;
+    bool incompressible; // compress() tried and gave up, so it will not try again
+    uint64_t hash;
+    int refs;
+    Blob* next; // next blob with the same hash
+};
+
+// Blobs smaller than this are left alone; the sequence overhead eats any gain.
+const size_t MIN_COMPRESS_SIZE = 64;
+
+struct BlobStoreStats {
+    int unique_blobs;
+    long long references;
+    size_t logical_bytes; // bytes as seen by the versions referencing blobs
+    size_t stored_bytes;  // bytes actually held, once per distinct content
+    int compressed_blobs;
+    size_t compressed_raw_bytes;
+    size_t compressed_stored_bytes;
+    long long decompressions;
+    long long decompress_ns;
+
+    size_t bytesSaved() const { return logical_bytes - stored_bytes; }
+
+    double dedupRatio() const {
+        if (stored_bytes == 0) {
+            return 1.0;
+        }
+        return static_cast<double>(logical_bytes) / stored_bytes;
+    }
+
+    double compressionRatio() const {
+        if (compressed_stored_bytes == 0) {
+            return 1.0;
+        }
+        return static_cast<double>(compressed_raw_bytes) / compressed_stored_bytes;
+    }
+
+    double averageDecompressMicros() const {
+        if (decompressions == 0) {
+            return 0.0;
+        }
+        return decompress_ns / 1000.0 / decompressions;
+    }
+};
+
+// Content-addressed store of blobs shared by all files of a FileSystem. Interning,
+// retaining and releasing are safe from several threads; compress() must not run
+// while another thread reads the blob it compresses.
+class BlobStore {
+private:
+    mutable mutex lock;
+    HashMap<uint64_t, Blob*> index; // hash -> chain of blobs with that hash
+    int blob_count;
+    long long references;
+    size_t logical_bytes; // bytes as seen by the versions referencing blobs
+    size_t stored_bytes;  // bytes actually held, once per distinct content
+    int compressed_count;
+    size_t compressed_raw_bytes;
+    size_t compressed_stored_bytes;
+    mutable atomic<long long> decompressions;
+    mutable atomic<long long> decompress_ns;
+
+    const Blob* retainLocked(const Blob* blob) {
+        Blob* owned = const_cast<Blob*>(blob);
+        owned->refs++;
+        references++;
+        logical_bytes += owned->size;
+        return owned;
+    }
+
+    bool sameBytes(const Blob* blob, const string& data) const {
+        if (blob->size != data.size()) {
+            return false;
+        }
+        if (!blob->compressed) {
+            return blob->data == data;
+        }
+        string raw;
+        return appendTo(blob, raw) && raw == data;
+    }
+
+public:
+    BlobStore()
+        : blob_count(0), references(0), logical_bytes(0), stored_bytes(0), compressed_count(0),
+          compressed_raw_bytes(0), compressed_stored_bytes(0), decompressions(0), decompress_ns(0) {}
+
+    ~BlobStore() {
+        vector<Blob*> chains = index.allVal();
+        for (Blob* blob : chains) {
+            while (blob != nullptr) {
+                Blob* next = blob->next;
+                delete blob;
+                blob = next;
+            }
+        }
+    }
+
+    // New content is moved into its blob rather than copied.
+    const Blob* intern(string data) {
+        uint64_t hash = contentHash(data);
+        lock_guard<mutex> guard(lock);
+        Blob** head = index.get(hash);
+        Blob* blob = head ? *head : nullptr;
+        while (blob != nullptr && !sameBytes(blob, data)) {
+            blob = blob->next;
+        }
+        if (blob == nullptr) {
+            size_t size = data.size();
+            blob = new Blob{std::move(data), size, false, false, hash, 0, head ? *head : nullptr};
+            index.INSERT(hash, blob);
+            blob_count++;
+            stored_bytes += size;
+        }
+        return retainLocked(blob);
+    }
+
+    const Blob* retain(const Blob* blob) {
+        lock_guard<mutex> guard(lock);
+        return retainLocked(blob);
+    }
+
+    void release(const Blob* blob) {
+        lock_guard<mutex> guard(lock);
+        Blob* owned = const_cast<Blob*>(blob);
+        references--;
+        logical_bytes -= owned->size;
+        if (--owned->refs > 0) {
+            return;
+        }
+        blob_count--;
+        stored_bytes -= owned->data.size();
+        if (owned->compressed) {
+            compressed_count--;
+            compressed_raw_bytes -= owned->size;
+            compressed_stored_bytes -= owned->data.size();
+        }
+
+        Blob** head = index.get(owned->hash);
+        if (*head == owned) {
+            if (owned->next == nullptr) {
+                index.erase(owned->hash);
+            } else {
+                *head = owned->next;
+            }
+        } else {
+            Blob* prev = *head;
+            while (prev->next != owned) {
+                prev = prev->next;
+            }
+            prev->next = owned->next;
+        }
+        delete owned;
+    }
+
+    // Appends the blob's bytes to `out`. Returns false, leaving `out` as it was,
+    // if a compressed blob does not decode.
+    bool appendTo(const Blob* blob, string& out) const {
+        if (!blob->compressed) {
+            out += blob->data;
+            return true;
+        }
+        auto start = chrono::steady_clock::now();
+        size_t base = out.size();
+        if (!lzDecompress(blob->data, blob->size, out)) {
+            out.resize(base);
+            return false;
+        }
+        decompressions++;
+        decompress_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    // Compresses a blob in place if that saves at least an eighth of it. Returns
+    // true if the blob is compressed afterwards. A blob that does not compress
+    // well enough is marked incompressible and not tried again.
+    bool compress(const Blob* blob) {
+        Blob* owned = const_cast<Blob*>(blob);
+        if (owned->compressed) {
+            return true;
+        }
+        if (owned->incompressible) {
+            return false;
+        }
+        string packed = owned->size < MIN_COMPRESS_SIZE ? string() : lzCompress(owned->data);
+        lock_guard<mutex> guard(lock);
+        if (owned->size < MIN_COMPRESS_SIZE || packed.size() > owned->size - owned->size / 8) {
+            owned->incompressible = true;
+            return false;
+        }
+        stored_bytes -= owned->size - packed.size();
+        compressed_count++;
+        compressed_raw_bytes += owned->size;
+        compressed_stored_bytes += packed.size();
+        owned->data = std::move(packed);
+        owned->compressed = true;
+        return true;
+    }
+
+    // The counters, read together under the store's lock, so callers need no
+    // lock of their own to get a consistent set.
+    BlobStoreStats stats() const {
+        lock_guard<mutex> guard(lock);
+        return BlobStoreStats{blob_count, references, logical_bytes, stored_bytes, compressed_count,
+                              compressed_raw_bytes, compressed_stored_bytes, decompressions, decompress_ns};
+    }
+};
+
+#endif
@@ -3,98 +3,290 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include "Stats.hpp"
+#ifdef TTFS_STATS
+#include <atomic>
+#include <cstdint>
+#endif
 
 using namespace std;
 
 template <typename K>
 struct KeyHasher {
-    size_t operator()(const K& key, int capacity) const {
-        return static_cast<size_t>(key) % capacity;
+    size_t operator()(const K& key) const {
+        return static_cast<size_t>(key);
+    }
+};
+
+// Secret keys for string hashing, drawn once per process so that nobody can
+// precompute a set of names that all land in the same slots.
+struct HashSecrets {
+    uint64_t k0, k1, k2;
+
+    static const HashSecrets& get() {
+        static const HashSecrets secrets = draw();
+        return secrets;
+    }
+
+private:
+    static HashSecrets draw() {
+        random_device device;
+        uint64_t seed = (static_cast<uint64_t>(device()) << 32) ^ device() ^
+                        static_cast<uint64_t>(chrono::steady_clock::now().time_since_epoch().count());
+        // splitmix64, so the three keys are well spread even from a weak seed
+        auto next = [&seed]() {
+            uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            return z ^ (z >> 31);
+        };
+        HashSecrets secrets;
+        secrets.k0 = next();
+        secrets.k1 = next();
+        secrets.k2 = next();
+        return secrets;
     }
 };
 
+// Folds the 128-bit product of a and b into 64 bits.
+inline uint64_t foldedMultiply(uint64_t a, uint64_t b) {
+    __uint128_t product = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+}
+
+inline uint64_t loadWord(const char* p) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+// Keyed hash that consumes 16 bytes per multiply. Both factors of every
+// multiply include a secret, so input cannot zero one out and reset the state.
 template <>
-struct KeyHasher<string> {
-    size_t operator()(const string& key, int capacity) const {
-        size_t hash = 0;
-        for (char c : key) {
-            hash = hash * 31 + c;
+struct KeyHasher<string_view> {
+    size_t operator()(string_view key) const {
+        const HashSecrets& s = HashSecrets::get();
+        const char* p = key.data();
+        size_t n = key.size();
+        uint64_t h = s.k0 ^ foldedMultiply(n ^ s.k1, s.k2);
+        for (; n >= 16; p += 16, n -= 16) {
+            h = foldedMultiply(loadWord(p) ^ s.k1, loadWord(p + 8) ^ h);
+        }
+        if (n >= 8) {
+            h = foldedMultiply(loadWord(p) ^ s.k1, loadWord(p + n - 8) ^ h);
+        } else if (n > 0) {
+            uint64_t tail = 0;
+            memcpy(&tail, p, n);
+            h = foldedMultiply(tail ^ s.k1, h ^ s.k2);
         }
-        return hash % capacity;
+        return static_cast<size_t>(foldedMultiply(h ^ s.k2, s.k0 ^ key.size()));
     }
 };
 
-template <typename K, typename V>
+template <>
+struct KeyHasher<string> {
+    size_t operator()(const string& key) const {
+        return KeyHasher<string_view>()(key);
+    }
+};
+
+#ifdef TTFS_STATS
+// Shape of a HashMap's table. A key's probe distance is how far it sits from
+// its home slot, the open-addressing counterpart of its position in a chain.
+struct HashMapStats {
+    long long entries;
+    long long capacity;
+    long long total_probe;
+    int max_probe;
+    uint64_t lookups;
+    uint64_t probes; // slots inspected by those lookups
+};
+#endif
+
+// Open-addressing hash map using Robin Hood linear probing. Entries live in one
+// flat slot array together with their full hash, so probes compare hashes before
+// keys and a resize never has to rehash a key. The table doubles once it is 7/8 full.
+//
+// Pointers returned by get() are invalidated by the next INSERT.
+template <typename K, typename V, typename Hasher = KeyHasher<K>>
 class HashMap {
 private:
-    struct HashNode {
+    struct Slot {
         K key;
-        V val; 
-        HashNode* next;
-        HashNode(K k, V v) : key(k), val(v), next(nullptr) {}
+        V val;
+        size_t hash;
+        int probe; // distance from the home slot, -1 if empty
+        Slot() : key(), val(), hash(0), probe(-1) {}
     };
 
-    vector<HashNode*> buckets;
+    vector<Slot> slots;
     int capacity;
-    int num_elements; 
-    KeyHasher<K> hasher;
+    int num_elements;
+    Hasher hasher;
+#ifdef TTFS_STATS
+    mutable atomic<uint64_t> lookup_count{0};
+    mutable atomic<uint64_t> probe_count{0};
+#endif
 
-    int hash(const K& key) const {
-        return hasher(key, capacity);
+    int home(size_t h) const {
+        return static_cast<int>(h & static_cast<size_t>(capacity - 1));
     }
 
-public:
-    HashMap(int initial_capacity = 16) : capacity(initial_capacity), num_elements(0) {
-        buckets.resize(capacity, nullptr);
+    int find(const K& key, size_t h) const {
+        int i = home(h);
+        for (int dist = 0; ; ++dist) {
+            const Slot& slot = slots[i];
+            if (slot.probe < dist) {
+                STATS_ONLY(countLookup(dist + 1);)
+                return -1;
+            }
+            if (slot.hash == h && slot.key == key) {
+                STATS_ONLY(countLookup(dist + 1);)
+                return i;
+            }
+            i = (i + 1) & (capacity - 1);
+        }
+    }
+
+#ifdef TTFS_STATS
+    void countLookup(int slots_inspected) const {
+        lookup_count.fetch_add(1, memory_order_relaxed);
+        probe_count.fetch_add(slots_inspected, memory_order_relaxed);
     }
+#endif
 
-    ~HashMap() {
-        for (int i = 0; i < capacity; ++i) {
-            HashNode* entry = buckets[i];
-            while (entry != nullptr) {
-                HashNode* prev = entry;
-                entry = entry->next;
-                delete prev;
+    void place(K key, V val, size_t h) {
+        Slot incoming;
+        incoming.key = std::move(key);
+        incoming.val = std::move(val);
+        incoming.hash = h;
+        incoming.probe = 0;
+        int i = home(h);
+        while (true) {
+            Slot& slot = slots[i];
+            if (slot.probe == -1) {
+                slot = std::move(incoming);
+                return;
+            }
+            if (slot.probe < incoming.probe) {
+                swap(slot, incoming);
             }
+            incoming.probe++;
+            i = (i + 1) & (capacity - 1);
         }
     }
 
-    V* get(const K& key) const {
-        int i = hash(key);
-        HashNode* entry = buckets[i];
-        while (entry != nullptr) {
-            if (entry->key == key) {
-                return &(entry->val);
+    void grow() {
+        vector<Slot> old_slots;
+        old_slots.swap(slots);
+        capacity *= 2;
+        slots.resize(capacity);
+        for (Slot& slot : old_slots) {
+            if (slot.probe != -1) {
+                place(std::move(slot.key), std::move(slot.val), slot.hash);
             }
-            entry = entry->next;
         }
-        return nullptr;
     }
-    
+
+public:
+    HashMap(int initial_capacity = 16) : capacity(1), num_elements(0) {
+        while (capacity < initial_capacity) {
+            capacity *= 2;
+        }
+        slots.resize(capacity);
+    }
+
+    // The hash get() and INSERT() would compute for `key`. Callers that look the
+    // same key up more than once can hash it once and pass it to the overloads
+    // below.
+    size_t hashOf(const K& key) const {
+        return hasher(key);
+    }
+
+    V* get(const K& key) {
+        return get(key, hasher(key));
+    }
+
+    const V* get(const K& key) const {
+        return get(key, hasher(key));
+    }
+
+    V* get(const K& key, size_t h) {
+        int i = find(key, h);
+        return i == -1 ? nullptr : &(slots[i].val);
+    }
+
+    const V* get(const K& key, size_t h) const {
+        int i = find(key, h);
+        return i == -1 ? nullptr : &(slots[i].val);
+    }
+
     void INSERT(const K& key, const V& val) {
-        int i = hash(key);
-        HashNode* head = buckets[i];
-        HashNode* curr = head;
-        while (curr != nullptr) {
-            if (curr->key == key) {
-                curr->val = val;
-                return;
-            }
-            curr = curr->next;
+        INSERT(key, val, hasher(key));
+    }
+
+    void INSERT(const K& key, const V& val, size_t h) {
+        int i = find(key, h);
+        if (i != -1) {
+            slots[i].val = val;
+            return;
+        }
+        if (8 * (num_elements + 1) > 7 * capacity) {
+            grow();
         }
-        HashNode* newNode = new HashNode(key, val);
-        newNode->next = head;
-        buckets[i] = newNode;
+        place(key, val, h);
         num_elements++;
     }
 
+    // Backward-shift deletion: later entries of the probe run move one slot closer
+    // to home, so no tombstones are left behind.
+    bool erase(const K& key) {
+        int i = find(key, hasher(key));
+        if (i == -1) {
+            return false;
+        }
+        int next = (i + 1) & (capacity - 1);
+        while (slots[next].probe > 0) {
+            slots[i] = std::move(slots[next]);
+            slots[i].probe--;
+            i = next;
+            next = (next + 1) & (capacity - 1);
+        }
+        slots[i] = Slot();
+        num_elements--;
+        return true;
+    }
+
+    int size() const {
+        return num_elements;
+    }
+
+#ifdef TTFS_STATS
+    HashMapStats probeStats() const {
+        HashMapStats stats{num_elements, capacity, 0, 0, lookup_count.load(memory_order_relaxed),
+                           probe_count.load(memory_order_relaxed)};
+        for (const Slot& slot : slots) {
+            if (slot.probe > 0) {
+                stats.total_probe += slot.probe;
+                stats.max_probe = slot.probe > stats.max_probe ? slot.probe : stats.max_probe;
+            }
+        }
+        return stats;
+    }
+#endif
+
     vector<V> allVal() const {
         vector<V> values;
-        for (int i = 0; i < capacity; ++i) {
-            HashNode* entry = buckets[i];
-            while (entry != nullptr) {
-                values.push_back(entry->val);
-                entry = entry->next;
+        values.reserve(num_elements);
+        for (const Slot& slot : slots) {
+            if (slot.probe != -1) {
+                values.push_back(slot.val);
             }
         }
         return values;
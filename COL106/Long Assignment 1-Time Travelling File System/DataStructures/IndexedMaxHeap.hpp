@@ -0,0 +1,148 @@
+#ifndef INDEXEDMAXHEAP_HPP
+#define INDEXEDMAXHEAP_HPP
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include "MaxHeap.hpp"
+
+using namespace std;
+
+// MaxHeap variant where every element is tagged with a small integer key, so an
+// element whose priority changed can be found and re-sifted in O(log n).
+template <typename T, typename Comparator>
+class IndexedMaxHeap {
+private:
+    vector<T> heap;
+    vector<int> keys;     // heap slot -> key
+    vector<int> position; // key -> heap slot, -1 if absent
+    Comparator compare;
+
+    int parent(int i) { return (i - 1) / 2; }
+    int leftChild(int i) { return 2 * i + 1; }
+    int rightChild(int i) { return 2 * i + 2; }
+
+    void swapSlots(int i, int j) {
+        swap(heap[i], heap[j]);
+        swap(keys[i], keys[j]);
+        position[keys[i]] = i;
+        position[keys[j]] = j;
+    }
+
+    void heapifyDown(int i) {
+        int heap_size = size();
+        while (true) {
+            int left = leftChild(i);
+            int right = rightChild(i);
+            int largest = i;
+
+            if (left < heap_size && compare(heap[largest], heap[left])) {
+                largest = left;
+            }
+            if (right < heap_size && compare(heap[largest], heap[right])) {
+                largest = right;
+            }
+            if (largest == i) {
+                return;
+            }
+            swapSlots(i, largest);
+            i = largest;
+        }
+    }
+
+    int heapifyUp(int i) {
+        while (i > 0 && compare(heap[parent(i)], heap[i])) {
+            swapSlots(i, parent(i));
+            i = parent(i);
+        }
+        return i;
+    }
+
+public:
+    IndexedMaxHeap(Comparator comp = Comparator()) : compare(comp) {}
+
+    bool contains(int key) const {
+        return key >= 0 && key < static_cast<int>(position.size()) && position[key] != -1;
+    }
+
+    void INSERT(int key, const T& val) {
+        if (contains(key)) {
+            heap[position[key]] = val;
+            update(key);
+            return;
+        }
+        if (key >= static_cast<int>(position.size())) {
+            position.resize(key + 1, -1);
+        }
+        heap.push_back(val);
+        keys.push_back(key);
+        position[key] = heap.size() - 1;
+        heapifyUp(heap.size() - 1);
+    }
+
+    // Restores the heap order after the priority of `key` changed in either direction.
+    void update(int key) {
+        if (!contains(key)) {
+            return;
+        }
+        int i = position[key];
+        if (heapifyUp(i) == i) {
+            heapifyDown(i);
+        }
+    }
+
+    // Restores the heap order in O(n) after the priorities of many keys changed
+    // at once, where update() per key could leave the order broken.
+    void rebuild() {
+        for (int i = size() / 2 - 1; i >= 0; --i) {
+            heapifyDown(i);
+        }
+    }
+
+    T extractMax() {
+        if (isEmpty()) {
+            cerr << "Error: Attempted to extract from an empty heap. Returning default-constructed val." << endl;
+            return T();
+        }
+        T max_val = heap[0];
+        position[keys[0]] = -1;
+        heap[0] = heap.back();
+        keys[0] = keys.back();
+        heap.pop_back();
+        keys.pop_back();
+        if (!isEmpty()) {
+            position[keys[0]] = 0;
+            heapifyDown(0);
+        }
+        return max_val;
+    }
+
+    T peekMax() const {
+        if (isEmpty()) {
+            cerr << "Error: Attempted to peek into an empty heap. Returning default-constructed val." << endl;
+            return T();
+        }
+        return heap[0];
+    }
+
+    bool isEmpty() const {
+        return heap.empty();
+    }
+
+    int size() const {
+        return heap.size();
+    }
+
+    // k == -1 returns every element.
+    vector<T> topK(int k) const {
+        return heapTopK(heap, compare, k);
+    }
+
+    void clear() {
+        heap.clear();
+        keys.clear();
+        position.clear();
+    }
+};
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef LZCODEC_HPP
+#define LZCODEC_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+// Byte-oriented LZ77 block codec in the style of LZ4. A block is a run of
+// sequences, each
+//
+//   [token][literal length+][literals][u16 offset][match length+]
+//
+// where the token's high nibble is the literal count and its low nibble the
+// match length minus 4; a nibble of 15 is continued by 255-valued bytes and a
+// final byte below 255. The last sequence has literals only. Matches are found
+// through a single-probe hash of the next four bytes, which keeps compression
+// close to memcpy speed; decoding is a plain copy loop.
+
+const int LZ_MIN_MATCH = 4;
+const int LZ_HASH_BITS = 14;
+const size_t LZ_MAX_OFFSET = 65535;
+
+inline uint32_t lzRead32(const char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void lzPutLength(string& out, size_t length) {
+    while (length >= 255) {
+        out.push_back(static_cast<char>(255));
+        length -= 255;
+    }
+    out.push_back(static_cast<char>(length));
+}
+
+inline void lzPutSequence(string& out, const char* literals, size_t literal_count, size_t offset, size_t match_length) {
+    size_t match_code = match_length ? match_length - LZ_MIN_MATCH : 0;
+    uint8_t token = static_cast<uint8_t>((literal_count < 15 ? literal_count : 15) << 4)
+                  | static_cast<uint8_t>(match_code < 15 ? match_code : 15);
+    out.push_back(static_cast<char>(token));
+    if (literal_count >= 15) {
+        lzPutLength(out, literal_count - 15);
+    }
+    out.append(literals, literal_count);
+    if (match_length == 0) {
+        return;
+    }
+    out.push_back(static_cast<char>(offset & 0xFF));
+    out.push_back(static_cast<char>(offset >> 8));
+    if (match_code >= 15) {
+        lzPutLength(out, match_code - 15);
+    }
+}
+
+inline string lzCompress(string_view in) {
+    string out;
+    out.reserve(in.size() / 2 + 16);
+    const char* src = in.data();
+    size_t n = in.size();
+    size_t anchor = 0;
+    size_t pos = 0;
+    if (n >= LZ_MIN_MATCH + 1) {
+        vector<int64_t> table(1 << LZ_HASH_BITS, -1);
+        while (pos + LZ_MIN_MATCH <= n) {
+            uint32_t word = lzRead32(src + pos);
+            uint32_t slot = (word * 2654435761u) >> (32 - LZ_HASH_BITS);
+            int64_t candidate = table[slot];
+            table[slot] = pos;
+            if (candidate < 0 || pos - candidate > LZ_MAX_OFFSET || lzRead32(src + candidate) != word) {
+                pos++;
+                continue;
+            }
+            size_t length = LZ_MIN_MATCH;
+            while (pos + length < n && src[candidate + length] == src[pos + length]) {
+                length++;
+            }
+            lzPutSequence(out, src + anchor, pos - anchor, pos - candidate, length);
+            pos += length;
+            anchor = pos;
+        }
+    }
+    lzPutSequence(out, src + anchor, n - anchor, 0, 0);
+    return out;
+}
+
+inline bool lzGetLength(const uint8_t*& ip, const uint8_t* end, size_t& length) {
+    uint8_t b;
+    do {
+        if (ip == end) {
+            return false;
+        }
+        b = *ip++;
+        length += b;
+    } while (b == 255);
+    return true;
+}
+
+// Appends the `raw_size` bytes encoded in `in` to `out`. Returns false, with
+// `out` in an unspecified state, if the block is malformed.
+inline bool lzDecompress(string_view in, size_t raw_size, string& out) {
+    size_t base = out.size();
+    out.resize(base + raw_size);
+    char* dst = &out[0] + base;
+    size_t produced = 0;
+    const uint8_t* ip = reinterpret_cast<const uint8_t*>(in.data());
+    const uint8_t* end = ip + in.size();
+    while (ip < end) {
+        uint8_t token = *ip++;
+        size_t literal_count = token >> 4;
+        if (literal_count == 15 && !lzGetLength(ip, end, literal_count)) {
+            return false;
+        }
+        if (static_cast<size_t>(end - ip) < literal_count || raw_size - produced < literal_count) {
+            return false;
+        }
+        memcpy(dst + produced, ip, literal_count);
+        ip += literal_count;
+        produced += literal_count;
+        if (ip == end) {
+            break;
+        }
+        if (end - ip < 2) {
+            return false;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        size_t length = token & 15;
+        if (length == 15 && !lzGetLength(ip, end, length)) {
+            return false;
+        }
+        length += LZ_MIN_MATCH;
+        if (offset == 0 || offset > produced || raw_size - produced < length) {
+            return false;
+        }
+        const char* match = dst + produced - offset;
+        for (size_t i = 0; i < length; ++i) {
+            dst[produced + i] = match[i];
+        }
+        produced += length;
+    }
+    return produced == raw_size;
+}
+
+#endif
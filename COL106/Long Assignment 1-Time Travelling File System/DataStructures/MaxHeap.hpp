@@ -7,6 +7,23 @@
 
 using namespace std;
 
+// Orders heap slots by the elements stored in them; used for the frontier in topK().
+template <typename T, typename Comparator>
+struct HeapSlotOrder {
+    const vector<T>* heap = nullptr;
+    Comparator compare;
+
+    bool operator()(int a, int b) const {
+        return compare((*heap)[a], (*heap)[b]);
+    }
+};
+
+// Returns the k largest elements of an array-backed heap in descending order
+// without modifying it. Only the frontier of candidate slots is kept in an
+// auxiliary heap, so this costs O(k log k) instead of copying the whole heap.
+template <typename T, typename Comparator>
+vector<T> heapTopK(const vector<T>& heap, const Comparator& compare, int k);
+
 template <typename T, typename Comparator>
 class MaxHeap {
 private:
@@ -18,20 +35,23 @@ private:
     int rightChild(int i) { return 2 * i + 2; }
 
     void heapifyDown(int i) {
-        int left = leftChild(i);
-        int right = rightChild(i);
-        int largest = i;
         int heap_size = size();
+        while (true) {
+            int left = leftChild(i);
+            int right = rightChild(i);
+            int largest = i;
 
-        if (left < heap_size && compare(heap[largest], heap[left])) {
-            largest = left;
-        }
-        if (right < heap_size && compare(heap[largest], heap[right])) {
-            largest = right;
-        }
-        if (largest != i) {
+            if (left < heap_size && compare(heap[largest], heap[left])) {
+                largest = left;
+            }
+            if (right < heap_size && compare(heap[largest], heap[right])) {
+                largest = right;
+            }
+            if (largest == i) {
+                return;
+            }
             swap(heap[i], heap[largest]);
-            heapifyDown(largest);
+            i = largest;
         }
     }
 
@@ -80,9 +100,40 @@ public:
         return heap.size();
     }
 
+    // k == -1 returns every element.
+    vector<T> topK(int k) const {
+        return heapTopK(heap, compare, k);
+    }
+
     void clear() {
         heap.clear();
     }
 };
 
+template <typename T, typename Comparator>
+vector<T> heapTopK(const vector<T>& heap, const Comparator& compare, int k) {
+    int heap_size = heap.size();
+    if (k == -1 || k > heap_size) {
+        k = heap_size;
+    }
+    vector<T> result;
+    if (k <= 0) {
+        return result;
+    }
+    result.reserve(k);
+
+    HeapSlotOrder<T, Comparator> order;
+    order.heap = &heap;
+    order.compare = compare;
+    MaxHeap<int, HeapSlotOrder<T, Comparator>> frontier(order);
+    frontier.INSERT(0);
+    while (static_cast<int>(result.size()) < k) {
+        int i = frontier.extractMax();
+        result.push_back(heap[i]);
+        if (2 * i + 1 < heap_size) frontier.INSERT(2 * i + 1);
+        if (2 * i + 2 < heap_size) frontier.INSERT(2 * i + 2);
+    }
+    return result;
+}
+
 #endif 
@@ -0,0 +1,124 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+// Instrumentation is only compiled in when TTFS_STATS is defined. Hooks in the
+// code are wrapped in STATS_ONLY(...), which expands to nothing otherwise.
+#ifdef TTFS_STATS
+#define STATS_ONLY(...) __VA_ARGS__
+#else
+#define STATS_ONLY(...)
+#endif
+
+#ifdef TTFS_STATS
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+using namespace std;
+
+// HDR-style latency histogram over nanoseconds: values below 2^SUB_BITS get a
+// bucket each, and every power of two above is split into 2^SUB_BITS linear
+// buckets, so any recorded value is known to within about 3%. Recording is a
+// few relaxed atomic adds and safe from any number of threads.
+class LatencyHistogram {
+private:
+    static const int SUB_BITS = 5;
+    static const int SUB_BUCKETS = 1 << SUB_BITS;
+    static const int MAX_BITS = 40; // about 18 minutes; longer values share the top bucket
+    static const int BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_BUCKETS;
+
+    atomic<uint64_t> counts[BUCKETS];
+    atomic<uint64_t> total;
+    atomic<uint64_t> sum;
+    atomic<uint64_t> largest;
+
+    static int bucketFor(uint64_t value) {
+        if (value < static_cast<uint64_t>(SUB_BUCKETS)) {
+            return static_cast<int>(value);
+        }
+        int msb = 63 - __builtin_clzll(value);
+        if (msb >= MAX_BITS) {
+            return BUCKETS - 1;
+        }
+        int shift = msb - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + static_cast<int>((value >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    // Largest value that falls in the bucket.
+    static uint64_t bucketTop(int bucket) {
+        int group = bucket / SUB_BUCKETS;
+        uint64_t sub = bucket % SUB_BUCKETS;
+        if (group == 0) {
+            return sub;
+        }
+        return ((SUB_BUCKETS + sub + 1) << (group - 1)) - 1;
+    }
+
+public:
+    LatencyHistogram() : total(0), sum(0), largest(0) {
+        for (atomic<uint64_t>& count : counts) {
+            count.store(0, memory_order_relaxed);
+        }
+    }
+
+    void record(uint64_t nanos) {
+        counts[bucketFor(nanos)].fetch_add(1, memory_order_relaxed);
+        total.fetch_add(1, memory_order_relaxed);
+        sum.fetch_add(nanos, memory_order_relaxed);
+        uint64_t seen = largest.load(memory_order_relaxed);
+        while (nanos > seen && !largest.compare_exchange_weak(seen, nanos, memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t count() const { return total.load(memory_order_relaxed); }
+    uint64_t max() const { return largest.load(memory_order_relaxed); }
+
+    double mean() const {
+        uint64_t n = count();
+        return n == 0 ? 0 : static_cast<double>(sum.load(memory_order_relaxed)) / n;
+    }
+
+    // Smallest bucket bound that at least fraction p of the values lie under.
+    uint64_t percentile(double p) const {
+        uint64_t n = count();
+        if (n == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(p * n + 0.999999);
+        rank = rank == 0 ? 1 : rank;
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; ++i) {
+            seen += counts[i].load(memory_order_relaxed);
+            if (seen >= rank) {
+                uint64_t top = bucketTop(i);
+                return top < max() ? top : max();
+            }
+        }
+        return max();
+    }
+};
+
+// Records the time from construction to stop() (or destruction) into a histogram.
+class LatencyTimer {
+private:
+    LatencyHistogram* histogram;
+    chrono::steady_clock::time_point start;
+
+public:
+    explicit LatencyTimer(LatencyHistogram& into) : histogram(&into), start(chrono::steady_clock::now()) {}
+    ~LatencyTimer() { stop(); }
+    LatencyTimer(const LatencyTimer&) = delete;
+    LatencyTimer& operator=(const LatencyTimer&) = delete;
+
+    void stop() {
+        if (histogram != nullptr) {
+            histogram->record(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+            histogram = nullptr;
+        }
+    }
+};
+
+#endif
+
+#endif
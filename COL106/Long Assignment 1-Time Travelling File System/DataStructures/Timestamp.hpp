@@ -0,0 +1,65 @@
+#ifndef TIMESTAMP_HPP
+#define TIMESTAMP_HPP
+
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <ctime>
+#include <cstdint>
+#include <cstdio>
+
+using namespace std;
+
+// Microseconds since the Unix epoch. Versions and changes are stamped at this
+// resolution so that a burst of writes within one second keeps its order.
+typedef int64_t Timestamp;
+
+const Timestamp MICROS_PER_SECOND = 1000000;
+
+inline Timestamp currentTimestamp() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+inline time_t toTimeT(Timestamp t) {
+    return static_cast<time_t>(t / MICROS_PER_SECOND);
+}
+
+// "<seconds>.<microseconds>", the form AS_OF and CHANGED_BETWEEN accept.
+inline string formatTimestamp(Timestamp t) {
+    char text[32];
+    snprintf(text, sizeof(text), "%lld.%06lld", static_cast<long long>(t / MICROS_PER_SECOND),
+             static_cast<long long>(t % MICROS_PER_SECOND));
+    return text;
+}
+
+// Parses seconds since the epoch with an optional fraction; digits past the
+// sixth decimal place are ignored.
+inline bool parseTimestamp(string_view text, Timestamp& t) {
+    size_t i = 0;
+    Timestamp seconds = 0;
+    while (i < text.size() && text[i] >= '0' && text[i] <= '9') {
+        if (i >= 12) {
+            return false;
+        }
+        seconds = seconds * 10 + (text[i++] - '0');
+    }
+    if (i == 0) {
+        return false;
+    }
+    Timestamp micros = 0;
+    if (i < text.size() && text[i] == '.') {
+        i++;
+        Timestamp scale = MICROS_PER_SECOND / 10;
+        for (; i < text.size() && text[i] >= '0' && text[i] <= '9'; ++i) {
+            micros += (text[i] - '0') * scale;
+            scale /= 10;
+        }
+    }
+    if (i != text.size()) {
+        return false;
+    }
+    t = seconds * MICROS_PER_SECOND + micros;
+    return true;
+}
+
+#endif
@@ -2,30 +2,166 @@
 #define TREENODE_HPP
 
 #include <string>
-#include <vector>
+#include <string_view>
 #include <ctime> 
+#include <cstdint>
+#include <atomic>
+#include <queue>
+#include <vector>
+#include <utility>
+#include "BlobStore.hpp"
+#include "Timestamp.hpp"
 
 using namespace std;
 
+// Nodes live in their File's arena and are owned by it; a node never frees its
+// children. Children form an intrusive sibling list so adding a version allocates
+// nothing beyond the node itself.
 class TreeNode {
 public:
     int version_id;
-    string content;
-    string message;
-    time_t created_timestamp;
-    time_t snapshot_timestamp;
+    // Content is stored as a delta against the parent version: either the full
+    // text (replaces_parent) or the text appended to the parent's content.
+    // Frozen versions keep their delta in the shared BlobStore, where it may be
+    // compressed once cold; the version still being edited keeps it in working_delta.
+    const Blob* delta;
+    string working_delta;
+    bool replaces_parent;
+    size_t content_length;
+    uint64_t content_hash; // contentHash of the full content
+    string_view message; // arena-owned text
+    Timestamp created_timestamp;
+    Timestamp snapshot_timestamp;
+    Timestamp modified_timestamp; // last change to the content
+    // Last write or read of the content, for cold-tier decisions. Readers sharing
+    // the file's lock all stamp it.
+    mutable atomic<Timestamp> last_touched;
+    bool tagged; // kept by garbage collection whatever the retention policy
     TreeNode* parent;
-    vector<TreeNode*> children;
+    TreeNode* merge_parent; // second parent of a MERGE version, which makes the history a DAG
+    TreeNode* first_child;
+    TreeNode* next_sibling;
+    // Skew-binary jump pointer: with depth it gives O(log n) ancestor and LCA
+    // queries while costing one pointer per node instead of a lifting table.
+    int depth;
+    TreeNode* jump;
 
-    TreeNode(int id, string initial_content, time_t creation_time, TreeNode* p = nullptr)
-        : version_id(id), content(initial_content), message(""),
-          created_timestamp(creation_time), snapshot_timestamp(0),
-          parent(p) {}
+    // A new node starts with the same content as its parent (or empty for a root).
+    TreeNode(int id, Timestamp creation_time, TreeNode* p = nullptr)
+        : version_id(id), delta(nullptr), replaces_parent(p == nullptr),
+          content_length(p ? p->content_length : 0),
+          content_hash(p ? p->content_hash : CONTENT_HASH_SEED), message(),
+          created_timestamp(creation_time), snapshot_timestamp(0), modified_timestamp(creation_time),
+          last_touched(creation_time), tagged(false),
+          parent(p), merge_parent(nullptr), first_child(nullptr), next_sibling(nullptr) {
+        if (p) {
+            next_sibling = p->first_child;
+            p->first_child = this;
+        }
+        computeJump();
+    }
+
+    // Derives depth and jump from the parent, whose own must already be current.
+    void computeJump() {
+        depth = parent ? parent->depth + 1 : 0;
+        jump = this;
+        if (parent) {
+            TreeNode* j = parent->jump;
+            jump = (parent->depth - j->depth == j->depth - j->jump->depth) ? j->jump : parent;
+        }
+    }
+
+    void unlinkChild(TreeNode* child) {
+        TreeNode** link = &first_child;
+        while (*link != child) {
+            link = &(*link)->next_sibling;
+        }
+        *link = child->next_sibling;
+        child->next_sibling = nullptr;
+    }
+
+    const TreeNode* ancestorAtDepth(int target_depth) const {
+        const TreeNode* node = this;
+        while (node->depth > target_depth) {
+            node = node->jump->depth >= target_depth ? node->jump : node->parent;
+        }
+        return node;
+    }
 
-    ~TreeNode() {
-        for (TreeNode* child : children) {
-            delete child;
+    static const TreeNode* lowestCommonAncestor(const TreeNode* a, const TreeNode* b) {
+        if (a->depth > b->depth) {
+            a = a->ancestorAtDepth(b->depth);
+        } else {
+            b = b->ancestorAtDepth(a->depth);
         }
+        while (a != b) {
+            if (a->jump != b->jump) {
+                a = a->jump;
+                b = b->jump;
+            } else {
+                a = a->parent;
+                b = b->parent;
+            }
+        }
+        return a;
+    }
+
+    // Base for merging a and b in the history DAG, where merge versions have a
+    // second parent: their newest common ancestor through either parent. No
+    // other common ancestor descends from it, since descendants have larger ids.
+    // Visiting versions in descending id order sees every child of a version
+    // before the version itself, so its marks are complete when it is reached;
+    // only versions newer than the base are visited.
+    static const TreeNode* mergeBase(const TreeNode* a, const TreeNode* b) {
+        const int FROM_A = 1, FROM_B = 2;
+        HashMap<int, int> marks; // version id -> FROM_A | FROM_B
+        priority_queue<pair<int, const TreeNode*>> pending;
+        auto mark = [&](const TreeNode* node, int from) {
+            int* seen = marks.get(node->version_id);
+            if (seen != nullptr) {
+                *seen |= from;
+                return;
+            }
+            marks.INSERT(node->version_id, from);
+            pending.push({node->version_id, node});
+        };
+        mark(a, FROM_A);
+        mark(b, FROM_B);
+        while (true) {
+            const TreeNode* node = pending.top().second;
+            pending.pop();
+            int from = *marks.get(node->version_id);
+            if (from == (FROM_A | FROM_B)) {
+                return node;
+            }
+            if (node->parent) {
+                mark(node->parent, from);
+            }
+            if (node->merge_parent) {
+                mark(node->merge_parent, from);
+            }
+        }
+    }
+
+    size_t deltaSize() const {
+        return delta ? delta->size : working_delta.size();
+    }
+
+    bool sameContent(const TreeNode* other) const {
+        return content_hash == other->content_hash && content_length == other->content_length;
+    }
+
+    void appendContent(string_view text) {
+        working_delta += text;
+        content_length += text.size();
+        content_hash = contentHash(text, content_hash);
+    }
+
+    void replaceContent(string text) {
+        content_length = text.size();
+        content_hash = contentHash(text);
+        working_delta = std::move(text);
+        replaces_parent = true;
     }
 };
 
@@ -1,103 +1,789 @@
 #include "File.hpp"
+#include "LineDiff.hpp"
 #include <iostream>
 #include <ctime>
 #include <iomanip> 
 #include <sstream> 
+#include <algorithm>
 
 using namespace std;
 
-File::File(const string& name, time_t t0)
-    : filename(name), next_version_id(1) {
-    root = new TreeNode(0, "", t0, nullptr);
-    root->message = "Initial_empty_snapshot";
+File::File(const string& name, Timestamp t0, int id, BlobStore* blob_store)
+    : filename(name), file_id(id), blobs(blob_store), next_version_id(1), live_versions(1) {
+    root = arena.create<TreeNode>(0, t0, nullptr);
+    root->message = arena.copyString("Initial_empty_snapshot");
     root->snapshot_timestamp = t0;
+    freeze(root);
     curr_version = root;
     last_change_t = t0;
-    version_map = new HashMap<int, TreeNode*>();
-    version_map->INSERT(0, root);
+    versions.push_back(root);
+    image = nullptr;
+    image_first_node = 0;
+    image_active_id = 0;
+    image_first_activation = 0;
+    image_activations = 0;
+    cached_version_id = 0;
+    activations.push_back(Activation{t0, 0});
 }
 
+File::File(const string& name, int id, BlobStore* blob_store)
+    : filename(name), file_id(id), blobs(blob_store), root(nullptr), curr_version(nullptr),
+      next_version_id(0), live_versions(0), last_change_t(0), image(nullptr), image_first_node(0),
+      image_active_id(0), image_first_activation(0), image_activations(0), cached_version_id(-1) {}
+
 File::~File() {
-    delete root;
-    delete version_map;
+    for (TreeNode* node : versions) {
+        if (node == nullptr) {
+            continue;
+        }
+        if (node->delta) {
+            blobs->release(node->delta);
+        }
+        node->~TreeNode();
+    }
 }
 
-string File::getFilename() const { return filename; }
-time_t File::LastChangeT() const { return last_change_t; }
-int File::TotalVersions() const { return next_version_id; }
-int File::ActiveVersionId() const { return curr_version->version_id; }
+const string& File::getFilename() const { return filename; }
+int File::getId() const { return file_id; }
+Timestamp File::LastChangeT() const { return last_change_t; }
+int File::TotalVersions() const { return live_versions; }
+int File::ActiveVersionId() const { return image ? image_active_id : curr_version->version_id; }
+bool File::isImageBacked() const { return image != nullptr; }
+shared_mutex& File::accessLock() const { return access_lock; }
 
-string File::READ() const {
-    return curr_version->content;
+TreeNode* File::newVersion(Timestamp mod_time) {
+    TreeNode* new_version = arena.create<TreeNode>(next_version_id++, mod_time, curr_version);
+    versions.push_back(new_version);
+    live_versions++;
+    activate(new_version, mod_time);
+    return new_version;
 }
 
-void File::INSERT(const string& content, time_t mod_time) {
-    if (curr_version->snapshot_timestamp != 0) {
-        TreeNode* new_version = new TreeNode(next_version_id++, curr_version->content + content, mod_time, curr_version);
-        curr_version->children.push_back(new_version);
-        cout << "New version " << new_version->version_id << " created for '" << filename << "'. Parent is version " << curr_version->version_id << "." << endl;
-        curr_version = new_version;
-        version_map->INSERT(new_version->version_id, new_version);
+void File::activate(TreeNode* node, Timestamp t) {
+    curr_version = node;
+    activations.push_back(Activation{t, node->version_id});
+}
+
+int File::activationCount() const {
+    return image_activations + activations.size();
+}
+
+Activation File::activationAt(int index) const {
+    if (index < image_activations) {
+        ImageActivationRecord record = image->activation(image_first_activation + index);
+        return Activation{record.time, record.version_id};
+    }
+    return activations[index - image_activations];
+}
+
+// Moves a version's delta into the shared blob store once it can no longer change.
+void File::freeze(TreeNode* node) {
+    if (node->delta == nullptr) {
+        node->delta = blobs->intern(std::move(node->working_delta));
+        string().swap(node->working_delta);
+        warm_versions.push_back(node->version_id);
+    }
+}
+
+bool File::appendDelta(const TreeNode* node, string& out) const {
+    if (node->delta) {
+        return blobs->appendTo(node->delta, out);
+    }
+    out += node->working_delta;
+    return true;
+}
+
+bool File::materialize(const TreeNode* node, string& content) const {
+    vector<const TreeNode*> chain;
+    Timestamp now = currentTimestamp();
+    while (true) {
+        node->last_touched = now;
+        chain.push_back(node);
+        if (node->replaces_parent) {
+            break;
+        }
+        node = node->parent;
+    }
+    content.clear();
+    content.reserve(chain.front()->content_length);
+    for (int i = chain.size() - 1; i >= 0; --i) {
+        if (!appendDelta(chain[i], content)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+ImageNodeRecord File::imageNode(int version_id) const {
+    return image->node(image_first_node + version_id);
+}
+
+string File::materializeFromImage(int version_id) const {
+    vector<ImageNodeRecord> chain;
+    while (true) {
+        ImageNodeRecord record = imageNode(version_id);
+        chain.push_back(record);
+        if (record.replaces_parent || record.parent < 0 || record.parent >= version_id) {
+            break;
+        }
+        version_id = record.parent;
+    }
+    string content;
+    for (int i = chain.size() - 1; i >= 0; --i) {
+        string_view delta = image->str(chain[i].delta_off, chain[i].delta_len);
+        content.append(delta.data(), delta.size());
+    }
+    return content;
+}
+
+// The active content when one buffer already holds all of it: a version whose
+// delta replaces its parent's content, kept as its working delta, an
+// uncompressed blob or a record of the mapped image.
+bool File::contiguousContent(string_view& view) const {
+    if (image) {
+        ImageNodeRecord record = imageNode(image_active_id);
+        if (!record.replaces_parent && record.parent >= 0 && record.parent < image_active_id) {
+            return false;
+        }
+        view = image->str(record.delta_off, record.delta_len);
+        return true;
+    }
+    if (!curr_version->replaces_parent || (curr_version->delta && curr_version->delta->compressed)) {
+        return false;
+    }
+    curr_version->last_touched = currentTimestamp();
+    view = curr_version->delta ? string_view(curr_version->delta->data) : string_view(curr_version->working_delta);
+    return true;
+}
+
+// Versions whose content is spread over a delta chain are materialised once
+// into cached_content; the rest are served from where they are stored.
+bool File::activeContent(string_view& content) const {
+    if (contiguousContent(content)) {
+        return true;
+    }
+    int active_id = ActiveVersionId();
+    if (cached_version_id != active_id) {
+        if (image) {
+            cached_content = materializeFromImage(active_id);
+        } else if (!materialize(curr_version, cached_content)) {
+            cached_version_id = -1;
+            return false;
+        }
+        cached_version_id = active_id;
+    }
+    content = cached_content;
+    return true;
+}
+
+// Copy-on-write from the image: builds the version tree the first time the file
+// changes. The whole tree is built at once, since TreeNode links its parents by
+// pointer; reads, DIFF and a GC that would remove nothing stay on the image.
+void File::loadNodes() {
+    if (image == nullptr) {
+        return;
+    }
+    for (int i = 0; i < next_version_id; ++i) {
+        ImageNodeRecord record = imageNode(i);
+        if (record.flags & IMAGE_NODE_PRUNED) {
+            versions.push_back(nullptr);
+            continue;
+        }
+        TreeNode* parent = (record.parent >= 0 && record.parent < i) ? versions[record.parent] : nullptr;
+        TreeNode* node = arena.create<TreeNode>(i, record.created, parent);
+        node->modified_timestamp = record.modified;
+        if (record.merge_parent >= 0 && record.merge_parent < i) {
+            node->merge_parent = versions[record.merge_parent];
+        }
+        string_view delta = image->str(record.delta_off, record.delta_len);
+        if (record.replaces_parent || parent == nullptr) {
+            node->replaceContent(string(delta));
+        } else {
+            node->appendContent(string(delta));
+        }
+        node->message = arena.copyString(image->str(record.message_off, record.message_len));
+        node->snapshot_timestamp = record.snapshot;
+        node->tagged = record.flags & IMAGE_NODE_TAGGED;
+        versions.push_back(node);
+    }
+    root = versions[0];
+    curr_version = versions[image_active_id];
+    vector<Activation> all_activations;
+    all_activations.reserve(activationCount());
+    for (int i = 0; i < activationCount(); ++i) {
+        all_activations.push_back(activationAt(i));
+    }
+    activations.swap(all_activations);
+    image_activations = 0;
+    for (TreeNode* node : versions) {
+        if (node && (node != curr_version || node->snapshot_timestamp != 0)) {
+            freeze(node);
+        }
+    }
+    image = nullptr;
+}
+
+bool File::READ(string_view& content) const {
+    lock_guard<mutex> guard(cache_lock);
+    return activeContent(content);
+}
+
+// A cache of the old active content is extended in place; otherwise it is left
+// to the next READ to rebuild.
+bool File::INSERT(string_view content, Timestamp mod_time) {
+    loadNodes();
+    bool cache_valid = cached_version_id == curr_version->version_id;
+    bool created = curr_version->snapshot_timestamp != 0;
+    if (created) {
+        newVersion(mod_time);
+    }
+    curr_version->appendContent(content);
+    curr_version->modified_timestamp = mod_time;
+    curr_version->last_touched = mod_time;
+    if (curr_version->replaces_parent) {
+        string().swap(cached_content);
+        cached_version_id = -1;
+    } else if (cache_valid) {
+        cached_content.append(content.data(), content.size());
+        cached_version_id = curr_version->version_id;
     } else {
-        curr_version->content += content;
-        cout << "Content inserted into active version " << curr_version->version_id << " of '" << filename << "'." << endl;
+        cached_version_id = -1;
     }
     last_change_t = mod_time;
+    return created;
 }
 
-void File::UPDATE(const string& content, time_t mod_time) {
-    if (curr_version->snapshot_timestamp != 0) {
-        TreeNode* new_version = new TreeNode(next_version_id++, content, mod_time, curr_version);
-        curr_version->children.push_back(new_version);
-        cout << "New version " << new_version->version_id << " created for '" << filename << "'. Parent is version " << curr_version->version_id << "." << endl;
-        curr_version = new_version;
-        version_map->INSERT(new_version->version_id, new_version);
-    } else {
-        curr_version->content = content;
-        cout << "Content updated for active version " << curr_version->version_id << " of '" << filename << "'." << endl;
+// The new content is moved into the version and served from there, so no
+// cached copy is kept.
+bool File::UPDATE(string content, Timestamp mod_time) {
+    loadNodes();
+    bool created = curr_version->snapshot_timestamp != 0;
+    if (created) {
+        newVersion(mod_time);
     }
+    curr_version->replaceContent(std::move(content));
+    curr_version->modified_timestamp = mod_time;
+    curr_version->last_touched = mod_time;
+    string().swap(cached_content);
+    cached_version_id = -1;
     last_change_t = mod_time;
+    return created;
 }
 
-void File::SNAPSHOT(const string& message, time_t snap_time) {
-    if (curr_version->snapshot_timestamp == 0) {
-        curr_version->message = message;
-        curr_version->snapshot_timestamp = snap_time;
-        cout << "Snapshot created for active version " << curr_version->version_id << " of '" << filename << "'." << endl;
-    } else {
-        cout << "Warning: Version " << curr_version->version_id << " is already a snapshot." << endl;
+bool File::SNAPSHOT(const string& message, Timestamp snap_time) {
+    loadNodes();
+    if (curr_version->snapshot_timestamp != 0) {
+        return false;
     }
+    curr_version->message = arena.copyString(message);
+    curr_version->snapshot_timestamp = snap_time;
+    freeze(curr_version);
+    return true;
 }
 
-bool File::ROLLBACK(int versionID) {
+bool File::ROLLBACK(int versionID, Timestamp rollback_time) {
+    if (image) {
+        int target = versionID;
+        if (target == -1) {
+            target = imageNode(image_active_id).parent;
+        } else if (target < 0 || target >= next_version_id || imageNode(target).snapshot == 0) {
+            return false;
+        }
+        if (target < 0) {
+            return false;
+        }
+        image_active_id = target;
+        activations.push_back(Activation{rollback_time, target});
+        return true;
+    }
     if (versionID != -1) {
-        TreeNode** target_node_ptr = version_map->get(versionID);
-        if (target_node_ptr && (*target_node_ptr)->snapshot_timestamp != 0) {
-            curr_version = *target_node_ptr;
+        if (versionID < 0 || versionID >= static_cast<int>(versions.size())) {
+            return false;
+        }
+        TreeNode* target = versions[versionID];
+        if (target && target->snapshot_timestamp != 0) {
+            freeze(curr_version);
+            activate(target, rollback_time);
             return true;
         }
         return false;
     } else {
         if (curr_version->parent) {
-            curr_version = curr_version->parent;
+            freeze(curr_version);
+            activate(curr_version->parent, rollback_time);
             return true;
         }
         return false;
     }
 }
 
-void File::HISTORY() const {
-    cout << "History for " << filename << ":" << endl;
+static void printHistoryEntry(ostream& out, int version_id, Timestamp snap_time, string_view message) {
+    time_t seconds = toTimeT(snap_time);
+    tm local;
+    localtime_r(&seconds, &local);
+    stringstream ss;
+    ss << put_time(&local, "%a %b %d %H:%M:%S %Y");
+    out << "Version " << version_id << ": " << ss.str() << " - " << message << '\n';
+}
+
+void File::HISTORY(ostream& out) const {
+    out << "History for " << filename << ":" << '\n';
+    if (image) {
+        for (int id = image_active_id; id >= 0; ) {
+            ImageNodeRecord record = imageNode(id);
+            if (record.snapshot != 0) {
+                printHistoryEntry(out, id, record.snapshot, image->str(record.message_off, record.message_len));
+            }
+            id = record.parent < id ? record.parent : -1;
+        }
+        return;
+    }
     TreeNode* current = curr_version;
     while (current != nullptr) {
         if (current->snapshot_timestamp != 0) {
-            time_t snap_time = current->snapshot_timestamp;
-            tm* ptm = localtime(&snap_time);
-            stringstream ss;
-            ss << put_time(ptm, "%a %b %d %H:%M:%S %Y");
-            cout << "Version " << current->version_id << ": " << ss.str() << " - " << current->message << endl;
+            printHistoryEntry(out, current->version_id, current->snapshot_timestamp, current->message);
         }
         current = current->parent;
     }
 }
 
+bool File::DIFF(int versionA, int versionB, ostream& out) const {
+    if (!HasVersion(versionA) || !HasVersion(versionB)) {
+        return false;
+    }
+    int lca_id;
+    string content_a, content_b;
+    if (image) {
+        // Parents have smaller ids, so stepping the larger id up meets at the LCA.
+        lca_id = versionA;
+        for (int other = versionB; lca_id != other; ) {
+            if (lca_id > other) {
+                lca_id = imageNode(lca_id).parent;
+            } else {
+                other = imageNode(other).parent;
+            }
+        }
+        content_a = materializeFromImage(versionA);
+        content_b = materializeFromImage(versionB);
+    } else {
+        const TreeNode* a = versions[versionA];
+        const TreeNode* b = versions[versionB];
+        lca_id = TreeNode::lowestCommonAncestor(a, b)->version_id;
+        if (!materialize(a, content_a) || !materialize(b, content_b)) {
+            return false;
+        }
+    }
+    out << "Diff for " << filename << " between version " << versionA << " and version " << versionB
+         << " (common ancestor: version " << lca_id << "):" << '\n';
+    if (content_a == content_b) {
+        out << "  No differences." << '\n';
+        return true;
+    }
+
+    vector<string_view> lines_a = splitLines(content_a);
+    vector<string_view> lines_b = splitLines(content_b);
+    for (const DiffOp& op : diffLines(lines_a, lines_b)) {
+        if (op.kind == DIFF_DELETE) {
+            out << "- " << op.a_line + 1 << ": " << lines_a[op.a_line] << '\n';
+        } else if (op.kind == DIFF_ADD) {
+            out << "+ " << op.b_line + 1 << ": " << lines_b[op.b_line] << '\n';
+        }
+    }
+    return true;
+}
+
+bool File::MERGE(int versionA, int versionB, Timestamp mod_time, int& base_id, int& conflicts) {
+    if (versionA < 0 || versionA >= next_version_id || versionB < 0 || versionB >= next_version_id) {
+        return false;
+    }
+    loadNodes();
+    TreeNode* a = versions[versionA];
+    TreeNode* b = versions[versionB];
+    if (a == nullptr || b == nullptr || a->snapshot_timestamp == 0 || b->snapshot_timestamp == 0) {
+        return false;
+    }
+    const TreeNode* base = TreeNode::mergeBase(a, b);
+    string content_base, content_a, content_b;
+    if (!materialize(base, content_base) || !materialize(a, content_a) || !materialize(b, content_b)) {
+        return false;
+    }
+    MergeResult merged = threeWayMerge(content_base, content_a, content_b,
+                                       "version " + to_string(versionA), "version " + to_string(versionB));
+    freeze(curr_version);
+    curr_version = a;
+    newVersion(mod_time);
+    curr_version->merge_parent = b;
+    curr_version->replaceContent(std::move(merged.content));
+    string().swap(cached_content);
+    cached_version_id = -1;
+    last_change_t = mod_time;
+    base_id = base->version_id;
+    conflicts = merged.conflicts;
+    return true;
+}
+
+bool File::TAG(int versionID) {
+    if (versionID < 0 || versionID >= next_version_id) {
+        return false;
+    }
+    loadNodes();
+    TreeNode* node = versions[versionID];
+    if (node == nullptr || node->snapshot_timestamp == 0) {
+        return false;
+    }
+    node->tagged = true;
+    return true;
+}
+
+// Whether GC would remove any version of an image-backed file, decided from
+// the image records alone. A version is removable if GC keeps it for no
+// reason and it has fewer than two children; if none is removable now, removing
+// nothing cannot make one removable.
+bool File::imageHasGarbage(int keep_last) const {
+    vector<bool> keep(next_version_id, false);
+    vector<int> children(next_version_id, 0);
+    int snapshots_seen = 0;
+    for (int i = next_version_id - 1; i >= 0; --i) {
+        ImageNodeRecord record = imageNode(i);
+        if (record.flags & IMAGE_NODE_PRUNED) {
+            continue;
+        }
+        if ((record.flags & IMAGE_NODE_TAGGED)
+            || (record.snapshot != 0 && (keep_last == -1 || snapshots_seen++ < keep_last))) {
+            keep[i] = true;
+        }
+        if (record.merge_parent >= 0) {
+            keep[record.parent] = true;
+            keep[record.merge_parent] = true;
+        }
+        if (record.parent >= 0) {
+            children[record.parent]++;
+        }
+    }
+    keep[0] = true;
+    keep[image_active_id] = true;
+    for (int i = 0; i < next_version_id; ++i) {
+        if (!keep[i] && children[i] < 2 && !(imageNode(i).flags & IMAGE_NODE_PRUNED)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The root, the active version, tagged snapshots, both parents of every merge
+// version, the keep_last newest snapshots and every version with more than one
+// child are kept. Of the rest, leaves are dropped outright; these include all
+// abandoned working versions, since new versions only ever branch off
+// snapshots. A version with a single child is spliced out by folding its delta
+// into the child. Walking ids downwards visits children first, so removals
+// cascade up through parents that become leaves. Removed ids are left as null
+// slots and never reused.
+bool File::GC(int keep_last, GcStats& stats) {
+    if (image && !imageHasGarbage(keep_last)) {
+        return false;
+    }
+    loadNodes();
+    vector<bool> keep(next_version_id, false);
+    int snapshots_seen = 0;
+    for (int i = next_version_id - 1; i >= 0; --i) {
+        TreeNode* node = versions[i];
+        if (node == nullptr) {
+            continue;
+        }
+        if (node->tagged || (node->snapshot_timestamp != 0 && (keep_last == -1 || snapshots_seen++ < keep_last))) {
+            keep[i] = true;
+        }
+        if (node->merge_parent) {
+            keep[node->parent->version_id] = true;
+            keep[node->merge_parent->version_id] = true;
+        }
+    }
+    keep[root->version_id] = true;
+    keep[curr_version->version_id] = true;
+
+    bool removed = false;
+    for (int i = next_version_id - 1; i >= 0; --i) {
+        TreeNode* node = versions[i];
+        if (node == nullptr || keep[i] || (node->first_child && node->first_child->next_sibling)) {
+            continue;
+        }
+        TreeNode* parent = node->parent;
+        TreeNode* child = node->first_child;
+        // A child that appends to this version takes its delta over. If either
+        // delta does not decode, the version stays rather than losing content.
+        bool fold = child != nullptr && !child->replaces_parent;
+        string delta;
+        if (fold && (!appendDelta(node, delta) || !appendDelta(child, delta))) {
+            continue;
+        }
+        parent->unlinkChild(node);
+        if (!fold) {
+            stats.bytes_released += node->deltaSize();
+        } else {
+            child->replaces_parent = node->replaces_parent;
+            if (child->delta) {
+                blobs->release(child->delta);
+                child->delta = blobs->intern(std::move(delta));
+                warm_versions.push_back(child->version_id);
+            } else {
+                child->working_delta = std::move(delta);
+            }
+        }
+        if (child != nullptr) {
+            child->parent = parent;
+            child->next_sibling = parent->first_child;
+            parent->first_child = child;
+        }
+        if (node->snapshot_timestamp != 0) {
+            stats.snapshots_removed++;
+        } else {
+            stats.working_removed++;
+        }
+        if (node->delta) {
+            blobs->release(node->delta);
+        }
+        node->~TreeNode();
+        versions[i] = nullptr;
+        live_versions--;
+        removed = true;
+    }
+
+    if (removed) {
+        for (TreeNode* node : versions) {
+            if (node) {
+                node->computeJump();
+            }
+        }
+        // A fold re-lists its child even if it already was on the frontier.
+        sort(warm_versions.begin(), warm_versions.end());
+        warm_versions.erase(unique(warm_versions.begin(), warm_versions.end()), warm_versions.end());
+    }
+    return removed;
+}
+
+// Only the warm frontier is scanned. A version leaves it once its blob is
+// compressed or has proved incompressible, so repeated sweeps cost the versions
+// still uncompressed rather than the whole tree.
+int File::compressCold(Timestamp now, long long max_age, int max_distance) {
+    if (image) {
+        return 0;
+    }
+    int compressed = 0;
+    size_t kept = 0;
+    for (int id : warm_versions) {
+        TreeNode* node = versions[id];
+        if (node == nullptr || node->delta->compressed || node->delta->incompressible) {
+            continue;
+        }
+        if (node != curr_version) {
+            bool cold = max_age >= 0 && now - node->last_touched > max_age * MICROS_PER_SECOND;
+            if (!cold && max_distance >= 0) {
+                const TreeNode* lca = TreeNode::lowestCommonAncestor(node, curr_version);
+                cold = node->depth + curr_version->depth - 2 * lca->depth > max_distance;
+            }
+            if (cold && blobs->compress(node->delta)) {
+                compressed++;
+                continue;
+            }
+            if (cold && node->delta->incompressible) {
+                continue;
+            }
+        }
+        warm_versions[kept++] = id;
+    }
+    warm_versions.resize(kept);
+    return compressed;
+}
+
+int File::VersionAt(Timestamp t) const {
+    int lo = 0, hi = activationCount();
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (activationAt(mid).time <= t) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo == 0 ? -1 : activationAt(lo - 1).version_id;
+}
+
+bool ContentReader::next(string_view& chunk) {
+    while (!pieces.empty()) {
+        Piece piece = pieces.back();
+        pieces.pop_back();
+        if (piece.blob == nullptr) {
+            chunk = piece.text;
+        } else if (!piece.blob->compressed) {
+            chunk = piece.blob->data;
+        } else {
+            scratch.clear();
+            if (!blobs->appendTo(piece.blob, scratch)) {
+                pieces.clear();
+                failed = true;
+                return false;
+            }
+            chunk = scratch;
+        }
+        if (!chunk.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool File::openVersion(int versionID, ContentReader& reader, Timestamp& modified) const {
+    if (versionID < 0 || versionID >= next_version_id) {
+        return false;
+    }
+    reader.blobs = blobs;
+    reader.pieces.clear();
+    reader.failed = false;
+    if (image) {
+        ImageNodeRecord record = imageNode(versionID);
+        if (record.flags & IMAGE_NODE_PRUNED) {
+            return false;
+        }
+        modified = record.modified;
+        for (int id = versionID; ; ) {
+            reader.pieces.push_back(ContentReader::Piece{nullptr, image->str(record.delta_off, record.delta_len)});
+            if (record.replaces_parent || record.parent < 0 || record.parent >= id) {
+                break;
+            }
+            id = record.parent;
+            record = imageNode(id);
+        }
+        return true;
+    }
+    const TreeNode* node = versions[versionID];
+    if (node == nullptr) {
+        return false;
+    }
+    modified = node->modified_timestamp;
+    Timestamp now = currentTimestamp();
+    while (true) {
+        node->last_touched = now;
+        reader.pieces.push_back(ContentReader::Piece{node->delta, node->working_delta});
+        if (node->replaces_parent) {
+            break;
+        }
+        node = node->parent;
+    }
+    return true;
+}
+
+bool File::HasVersion(int versionID) const {
+    if (versionID < 0 || versionID >= next_version_id) {
+        return false;
+    }
+    if (image) {
+        return !(imageNode(versionID).flags & IMAGE_NODE_PRUNED);
+    }
+    return versions[versionID] != nullptr;
+}
+
+bool File::IsSnapshot(int versionID) const {
+    if (!HasVersion(versionID)) {
+        return false;
+    }
+    return image ? imageNode(versionID).snapshot != 0 : versions[versionID]->snapshot_timestamp != 0;
+}
+
+bool File::forEachVersion(const function<void(const VersionText&)>& visit) const {
+    if (image) {
+        for (int id = 0; id < next_version_id; ++id) {
+            ImageNodeRecord record = imageNode(id);
+            if (record.flags & IMAGE_NODE_PRUNED) {
+                continue;
+            }
+            int parent = (record.parent >= 0 && record.parent < id) ? record.parent : -1;
+            string_view message = record.snapshot != 0 ? image->str(record.message_off, record.message_len) : string_view();
+            visit(VersionText{id, parent, record.replaces_parent || parent == -1,
+                              image->str(record.delta_off, record.delta_len), message});
+        }
+        return true;
+    }
+    string delta;
+    for (const TreeNode* node : versions) {
+        if (node == nullptr) {
+            continue;
+        }
+        delta.clear();
+        if (!appendDelta(node, delta)) {
+            return false;
+        }
+        string_view message = node->snapshot_timestamp != 0 ? node->message : string_view();
+        visit(VersionText{node->version_id, node->parent ? node->parent->version_id : -1, node->replaces_parent,
+                          delta, message});
+    }
+    return true;
+}
+
+#ifdef TTFS_STATS
+void File::addMemoryStats(FileMemoryStats& stats) const {
+    stats.nodes += live_versions;
+    stats.arena_bytes += arena.bytesReserved();
+    if (curr_version != nullptr) {
+        stats.working_bytes += curr_version->working_delta.capacity();
+    }
+    lock_guard<mutex> guard(cache_lock);
+    stats.cached_bytes += cached_content.capacity();
+}
+#endif
+
+File* File::fromImage(const SnapshotImage* image, uint32_t index, BlobStore* blob_store) {
+    ImageFileRecord record = image->file(index);
+    if (record.num_nodes <= 0 || record.active_id < 0 || record.active_id >= record.num_nodes) {
+        return nullptr;
+    }
+    File* file = new File(string(image->str(record.name_off, record.name_len)), record.file_id, blob_store);
+    file->last_change_t = record.last_change;
+    file->next_version_id = record.num_nodes;
+    file->live_versions = record.live_nodes;
+    file->attachImage(image, index);
+    file->image_active_id = record.active_id;
+    return file;
+}
+
+void File::attachImage(const SnapshotImage* new_image, uint32_t index) {
+    ImageFileRecord record = new_image->file(index);
+    image = new_image;
+    image_first_node = record.first_node;
+    image_first_activation = record.first_activation;
+    image_activations = record.num_activations;
+    activations.clear();
+}
+
+bool File::writeImage(SnapshotImageWriter& out) const {
+    out.beginFile(filename, file_id, last_change_t, ActiveVersionId());
+    for (int i = 0; i < next_version_id; ++i) {
+        if (image) {
+            ImageNodeRecord record = imageNode(i);
+            out.addNode(record.parent, record.merge_parent, record.replaces_parent,
+                        record.created, record.snapshot, record.modified,
+                        image->str(record.message_off, record.message_len),
+                        image->str(record.delta_off, record.delta_len), record.flags);
+        } else if (versions[i] == nullptr) {
+            out.addNode(-1, -1, false, 0, 0, 0, string_view(), string_view(), IMAGE_NODE_PRUNED);
+        } else {
+            const TreeNode* node = versions[i];
+            string_view delta = node->delta ? string_view(node->delta->data) : string_view(node->working_delta);
+            string decompressed;
+            if (node->delta && node->delta->compressed) {
+                if (!appendDelta(node, decompressed)) {
+                    return false;
+                }
+                delta = decompressed;
+            }
+            out.addNode(node->parent ? node->parent->version_id : -1,
+                        node->merge_parent ? node->merge_parent->version_id : -1, node->replaces_parent,
+                        node->created_timestamp, node->snapshot_timestamp, node->modified_timestamp,
+                        node->message, delta, node->tagged ? static_cast<uint32_t>(IMAGE_NODE_TAGGED) : 0u);
+        }
+    }
+    for (int i = 0; i < activationCount(); ++i) {
+        Activation activation = activationAt(i);
+        out.addActivation(activation.time, activation.version_id);
+    }
+    return true;
+}
@@ -2,36 +2,199 @@
 #define FILE_HPP
 
 #include "../DataStructures/TreeNode.hpp"
-#include "../DataStructures/HashMap.hpp"
+#include "../DataStructures/Arena.hpp"
+#include "../Storage/SnapshotImage.hpp"
+#include "../DataStructures/Stats.hpp"
 #include <string>
+#include <vector>
 #include <ctime> 
+#include <iostream>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <functional>
 
 using namespace std;
 
+// The active version switched to version_id at `time`.
+struct Activation {
+    Timestamp time;
+    int version_id;
+};
+
+struct GcStats {
+    int working_removed;
+    int snapshots_removed;
+    size_t bytes_released;
+};
+
+// How one version's content is stored: `delta` replaces the parent's content
+// or is appended to it. `message` is empty for versions that are not snapshots.
+struct VersionText {
+    int version_id;
+    int parent_id; // -1 for the root
+    bool replaces_parent;
+    string_view delta;
+    string_view message;
+};
+
+// Pulls a version's content one stored piece at a time, oldest first, so a long
+// delta chain is streamed without being assembled. Uncompressed pieces are views
+// of the stored bytes; compressed ones are unpacked into a buffer that the next
+// call reuses. Valid while the file's lock is held and the file is unchanged.
+class ContentReader {
+private:
+    friend class File;
+    struct Piece {
+        const Blob* blob; // null when the piece is `text`
+        string_view text;
+    };
+    const BlobStore* blobs;
+    vector<Piece> pieces; // newest first
+    string scratch;
+    bool failed;
+
+public:
+    ContentReader() : blobs(nullptr), failed(false) {}
+    // Sets `chunk` to the next non-empty piece; false once the content is
+    // exhausted or a compressed piece does not decode.
+    bool next(string_view& chunk);
+    // True if next() stopped at a piece that did not decode.
+    bool corrupt() const { return failed; }
+};
+
+#ifdef TTFS_STATS
+struct FileMemoryStats {
+    long long nodes;
+    size_t arena_bytes;   // TreeNodes and snapshot messages
+    size_t working_bytes; // deltas of versions still being edited
+    size_t cached_bytes;  // materialised active content
+};
+#endif
+
 class File {
 private:
     string filename;
+    int file_id;
+    BlobStore* blobs;
+    Arena arena; // TreeNodes and snapshot messages; freed in one shot with the file
     TreeNode* root;
     TreeNode* curr_version;
-    HashMap<int, TreeNode*>* version_map;
+    vector<TreeNode*> versions; // version id -> node, null once GC removes it; owns every node
+    // Frozen versions whose blobs compressCold has not yet compressed or found
+    // incompressible: the frontier a cold sweep has left to look at.
+    vector<int> warm_versions;
     int next_version_id;
-    time_t last_change_t; 
+    // Atomic because the rankings read them without holding this file's lock.
+    atomic<int> live_versions;
+    atomic<Timestamp> last_change_t;
+    // Time index for AS_OF: every switch of the active version, in time order.
+    // For an image-backed file the first image_activations entries are read
+    // from the image and `activations` holds only the ones since.
+    vector<Activation> activations;
+
+    // Taken by FileSystem: shared for commands that only read this file,
+    // exclusive for ones that change it.
+    mutable shared_mutex access_lock;
+
+    // While set, the file is served straight from a mapped checkpoint image and
+    // `versions` is empty; the TreeNodes are only built by loadNodes() when the
+    // file is first modified.
+    const SnapshotImage* image;
+    uint64_t image_first_node;
+    int image_active_id;
+    uint64_t image_first_activation;
+    int image_activations;
+
+    // Materialised content of version cached_version_id, normally the active version.
+    // Concurrent readers fill it under cache_lock.
+    mutable string cached_content;
+    mutable int cached_version_id;
+    mutable mutex cache_lock;
+
+    File(const string& name, int id, BlobStore* blob_store);
+
+    TreeNode* newVersion(Timestamp mod_time);
+    void activate(TreeNode* node, Timestamp t);
+    int activationCount() const;
+    Activation activationAt(int index) const;
+    void freeze(TreeNode* node);
+    void loadNodes();
+    ImageNodeRecord imageNode(int version_id) const;
+    // These return false if a compressed delta does not decode.
+    bool appendDelta(const TreeNode* node, string& out) const;
+    bool materialize(const TreeNode* node, string& content) const;
+    string materializeFromImage(int version_id) const;
+    bool imageHasGarbage(int keep_last) const;
+    bool contiguousContent(string_view& view) const;
+    bool activeContent(string_view& content) const;
 
 public:
-    File(const string& name, time_t creation_time);
+    File(const string& name, Timestamp creation_time, int id, BlobStore* blob_store);
     ~File();
 
-    string getFilename() const;
-    time_t LastChangeT() const;
+    const string& getFilename() const;
+    int getId() const;
+    Timestamp LastChangeT() const;
     int TotalVersions() const;
     int ActiveVersionId() const;
+    shared_mutex& accessLock() const;
+
+    // Sets `content` to the active version's content. The view is valid while
+    // the caller holds accessLock() and until the file next changes. Returns
+    // false if stored content does not decode.
+    bool READ(string_view& content) const;
+    // INSERT and UPDATE return true if the change created a new version.
+    bool INSERT(string_view content, Timestamp mod_time);
+    bool UPDATE(string content, Timestamp mod_time);
+    // Returns false if the active version is already a snapshot.
+    bool SNAPSHOT(const string& message, Timestamp snap_time);
+    bool ROLLBACK(int versionID, Timestamp rollback_time);
+    void HISTORY(ostream& out = cout) const;
+    // Prints a line diff between two versions; returns false if either does not
+    // exist or its content does not decode. Reads image-backed files in place,
+    // so a shared accessLock() will do.
+    bool DIFF(int versionA, int versionB, ostream& out = cout) const;
+    // Three-way merges two snapshots into a new active version whose parents are
+    // versionA and versionB. Returns false if either is missing or not a
+    // snapshot, or if content to merge does not decode.
+    bool MERGE(int versionA, int versionB, Timestamp mod_time, int& base_id, int& conflicts);
+    // Marks a snapshot to be kept by GC. Returns false if it is missing or not a snapshot.
+    bool TAG(int versionID);
+    // Drops versions outside the retention policy, keeping the ids of the rest.
+    // keep_last is how many of the newest snapshots to keep, or -1 for all of
+    // them. Returns true if anything was removed, and adds to `stats`.
+    bool GC(int keep_last, GcStats& stats);
+    // Compresses the content of cold versions: those more than max_distance
+    // edges away from the active version in the tree, or not written or read
+    // for max_age seconds. A negative limit turns its test off. Returns the
+    // number of versions compressed.
+    int compressCold(Timestamp now, long long max_age, int max_distance);
+    // Version that was active at time t, found by binary search over the
+    // activations; -1 if the file did not exist yet.
+    int VersionAt(Timestamp t) const;
+    // Points `reader` at the current content of a version and sets when it last
+    // changed. Returns false if the version does not exist or was removed by GC.
+    // Like DIFF, it only needs a shared accessLock().
+    bool openVersion(int versionID, ContentReader& reader, Timestamp& modified) const;
+    // False if the version never existed or was removed by GC.
+    bool HasVersion(int versionID) const;
+    bool IsSnapshot(int versionID) const;
+    // Calls `visit` for every version in id order, so parents come before their
+    // children. Returns false, having stopped, if a delta does not decode.
+    bool forEachVersion(const function<void(const VersionText&)>& visit) const;
+
+#ifdef TTFS_STATS
+    // Adds what this file holds outside the blob store to `stats`.
+    void addMemoryStats(FileMemoryStats& stats) const;
+#endif
 
-    string READ() const;
-    void INSERT(const string& content, time_t mod_time);
-    void UPDATE(const string& content, time_t mod_time);
-    void SNAPSHOT(const string& message, time_t snap_time);
-    bool ROLLBACK(int versionID = -1);
-    void HISTORY() const;
+    static File* fromImage(const SnapshotImage* image, uint32_t index, BlobStore* blob_store);
+    bool isImageBacked() const;
+    // Serves the file from record `index` of an image holding its current state.
+    void attachImage(const SnapshotImage* new_image, uint32_t index);
+    // Returns false if a compressed delta does not decode.
+    bool writeImage(SnapshotImageWriter& out) const;
 };
 
 #endif
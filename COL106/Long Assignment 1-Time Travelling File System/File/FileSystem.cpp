@@ -1,136 +1,1070 @@
 #include "FileSystem.hpp"
 #include <iostream>
 #include <vector>
+#include <algorithm>
 #include <ctime>
-#include <iomanip> 
-#include <sstream> 
+#include <iomanip>
+#include <sstream>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 using namespace std;
 
-FileSystem::FileSystem() {
-    files = new HashMap<string, File*>();
-    recentFiles = new MaxHeap<File*, ChangeT>();
-    biggestTree = new MaxHeap<File*, VersionCount>();
+static const long long COLD_SWEEP_INTERVAL = 1024;
+
+FileSystem::FileSystem()
+    : num_files(0), system_clock(0), search_built(false), gc_due(false), sweep_due(false), checkpoint_due(false), wal(nullptr),
+      image(nullptr), checkpoint_lsn(0), checkpoint_every(0), gc_every(0), gc_keep_last(-1),
+      changes_since_gc(0), cold_age(-1), cold_depth(-1), changes_since_sweep(0),
+      defer_heaps(false), heaps_stale(false) {
+    blobs = new BlobStore();
+    shards = new FileShard[FILE_SHARDS];
+    recentFiles = new IndexedMaxHeap<File*, ChangeT>();
+    biggestTree = new IndexedMaxHeap<File*, VersionCount>();
 }
 
 FileSystem::~FileSystem() {
-    vector<File*> all_files = files->allVal();
-    for (File* file : all_files) {
+    delete wal;
+    for (File* file : allFiles()) {
         delete file;
     }
-    delete files;
+    delete[] shards;
     delete recentFiles;
     delete biggestTree;
+    delete image;
+    delete blobs;
+}
+
+size_t FileSystem::nameHash(const string& filename) const {
+    return shards[0].files.hashOf(filename);
+}
+
+// Tables index slots with the low bits of the hash, so shards use the high ones.
+FileSystem::FileShard& FileSystem::shardFor(size_t name_hash) const {
+    return shards[static_cast<uint64_t>(name_hash) >> 58];
+}
+
+File* FileSystem::findFile(const string& filename) {
+    return findFile(filename, nameHash(filename));
+}
+
+File* FileSystem::findFile(const string& filename, size_t name_hash) {
+    STATS_ONLY(LatencyTimer timing(stage_latency[STAGE_LOOKUP]);)
+    FileShard& shard = shardFor(name_hash);
+    shared_lock<shared_mutex> guard(shard.lock);
+    File** file_ptr = shard.files.get(filename, name_hash);
+    return file_ptr ? *file_ptr : nullptr;
 }
 
-void FileSystem::rebuildHeaps() {
-    recentFiles->clear();
-    biggestTree->clear();
-    vector<File*> all_files = files->allVal();
-    for (File* file_ptr : all_files) {
-        recentFiles->INSERT(file_ptr);
-        biggestTree->INSERT(file_ptr);
+vector<File*> FileSystem::allFiles() const {
+    vector<File*> all_files;
+    for (int i = 0; i < FILE_SHARDS; ++i) {
+        vector<File*> shard_files = shards[i].files.allVal();
+        all_files.insert(all_files.end(), shard_files.begin(), shard_files.end());
     }
+    return all_files;
 }
 
-void FileSystem::CREATE(const string& filename) {
-    if (files->get(filename) != nullptr) {
-        cerr << "Error: File '" << filename << "' already exists." << endl;
+void FileSystem::touchHeaps(File* file) {
+    STATS_ONLY(LatencyTimer timing(stage_latency[STAGE_RANKING]);)
+    lock_guard<mutex> guard(rank_lock);
+    if (!defer_heaps) {
+        recentFiles->update(file->getId());
+        biggestTree->update(file->getId());
         return;
     }
-    File* new_file = new File(filename, time(0));
-    files->INSERT(filename, new_file);
-    rebuildHeaps();
-    cout << "File '" << filename << "' created with snapshot version 0." << endl;
+    int id = file->getId();
+    if (id >= static_cast<int>(heap_dirty.size())) {
+        heap_dirty.resize(id + 1, 0);
+    }
+    if (!heap_dirty[id]) {
+        heap_dirty[id] = 1;
+        dirty_files.push_back(file);
+    }
+}
+
+// A single changed entry can be re-sifted; once several are out of order (or a
+// file was inserted past a stale entry) sifting them one by one is not enough,
+// so both heaps are rebuilt. Callers hold rank_lock.
+void FileSystem::flushHeaps() {
+    STATS_ONLY(LatencyTimer timing(stage_latency[STAGE_RANKING]);)
+    if (dirty_files.size() == 1 && !heaps_stale) {
+        recentFiles->update(dirty_files[0]->getId());
+        biggestTree->update(dirty_files[0]->getId());
+    } else if (!dirty_files.empty()) {
+        recentFiles->rebuild();
+        biggestTree->rebuild();
+        STATS_ONLY(heap_rebuilds++;)
+    }
+    for (File* file : dirty_files) {
+        heap_dirty[file->getId()] = 0;
+    }
+    dirty_files.clear();
+    heaps_stale = false;
+}
+
+void FileSystem::beginBatch() {
+    lock_guard<mutex> guard(rank_lock);
+    defer_heaps = true;
+}
+
+void FileSystem::endBatch() {
+    lock_guard<mutex> guard(rank_lock);
+    flushHeaps();
+    defer_heaps = false;
+}
+
+// Wall-clock time, nudged forward when needed so that every change gets a
+// distinct timestamp later than all earlier ones, even when the clock steps
+// back or several changes land in the same microsecond.
+Timestamp FileSystem::now() {
+    Timestamp t = currentTimestamp();
+    Timestamp last = system_clock.load();
+    while (true) {
+        Timestamp next = t > last ? t : last + 1;
+        if (system_clock.compare_exchange_weak(last, next)) {
+            return next;
+        }
+    }
+}
+
+void FileSystem::noteChange(File* file, LogOp op, Timestamp t) {
+    modifications.add(Modification{t, file->getId(), file->ActiveVersionId(), op});
+    if (gc_every > 0 && ++changes_since_gc >= gc_every) {
+        changes_since_gc = 0;
+        gc_due = true;
+    }
+    if ((cold_age >= 0 || cold_depth >= 0) && ++changes_since_sweep >= COLD_SWEEP_INTERVAL) {
+        changes_since_sweep = 0;
+        sweep_due = true;
+    }
 }
 
-void FileSystem::READ(const string& filename) {
-    File** file_ptr = files->get(filename);
-    if (file_ptr == nullptr) {
-        cerr << "Error: File '" << filename << "' not found." << endl;
+// Indexes every version of a file that was just created, or that the index
+// has not covered yet.
+void FileSystem::indexFile(File* file) {
+    int id = file->getId();
+    search_index.addFile(id);
+    bool complete = file->forEachVersion([this, id](const VersionText& version) {
+        if (version.replaces_parent) {
+            search_index.update(id, version.version_id, version.delta);
+        } else {
+            search_index.insert(id, version.version_id, version.parent_id, version.delta);
+        }
+        if (!version.message.empty()) {
+            search_index.snapshot(id, version.version_id, version.message);
+        }
+    });
+    if (!complete) {
+        cerr << "Warning: Stored content of '" << file->getFilename() << "' does not decode; SEARCH may miss some of it." << endl;
+    }
+    search_index.activate(id, file->ActiveVersionId());
+}
+
+// Runs with maintenance_lock held exclusively.
+void FileSystem::buildSearchIndex() {
+    if (search_built) {
         return;
     }
-    cout << (*file_ptr)->READ() << endl;
+    for (File* file : allFiles()) {
+        indexFile(file);
+    }
+    search_built = true;
 }
 
-void FileSystem::INSERT(const string& filename, const string& content) {
-    File** file_ptr = files->get(filename);
-    if (file_ptr == nullptr) {
-        cerr << "Error: File '" << filename << "' not found." << endl;
+// Brings the search index up to date after a change, made by a command or
+// replayed from the log; parent_id is the version active before it.
+void FileSystem::indexChange(File* file, LogOp op, string_view text, int parent_id, bool created) {
+    if (!search_built) {
         return;
     }
-    (*file_ptr)->INSERT(content, time(0));
-    rebuildHeaps();
+    int id = file->getId();
+    int active_id = file->ActiveVersionId();
+    switch (op) {
+        case LOG_INSERT:
+            search_index.insert(id, active_id, created ? parent_id : -1, text);
+            break;
+        case LOG_UPDATE:
+            search_index.update(id, active_id, text);
+            break;
+        case LOG_SNAPSHOT:
+            search_index.snapshot(id, active_id, text);
+            break;
+        case LOG_ROLLBACK:
+            search_index.activate(id, active_id);
+            break;
+        case LOG_MERGE: {
+            // The merged content is held uncompressed, so it always reads back.
+            string_view merged;
+            file->READ(merged);
+            search_index.update(id, active_id, merged);
+            break;
+        }
+        case LOG_GC:
+            for (int version_id : search_index.liveVersions(id)) {
+                if (!file->HasVersion(version_id)) {
+                    search_index.removeVersion(id, version_id);
+                }
+            }
+            break;
+        default:
+            break;
+    }
 }
 
-void FileSystem::UPDATE(const string& filename, const string& content) {
-    File** file_ptr = files->get(filename);
-    if (file_ptr == nullptr) {
-        cerr << "Error: File '" << filename << "' not found." << endl;
+void FileSystem::runMaintenance() {
+    if (!gc_due && !sweep_due && !checkpoint_due) {
         return;
     }
-    (*file_ptr)->UPDATE(content, time(0));
-    rebuildHeaps();
+    unique_lock<shared_mutex> exclusive(maintenance_lock);
+    STATS_ONLY(LatencyTimer timing(stage_latency[STAGE_MAINTENANCE]);)
+    if (gc_due.exchange(false)) {
+        collectGarbage(gc_keep_last);
+    }
+    if (sweep_due.exchange(false)) {
+        sweepCold();
+    }
+    if (checkpoint_due.exchange(false)) {
+        writeCheckpoint();
+    }
+}
+
+// Each file that loses versions gets its own GC record, so replay repeats the
+// pass on exactly those files.
+GcStats FileSystem::collectGarbage(int keep_last) {
+    GcStats stats{0, 0, 0};
+    Timestamp t = now();
+    for (File* file : allFiles()) {
+        if (file->GC(keep_last, stats)) {
+            touchHeaps(file);
+            indexChange(file, LOG_GC, "", -1, false);
+            logRecord(LOG_GC, t, file->getFilename(), "", keep_last);
+        }
+    }
+    changes_since_gc = 0;
+    return stats;
+}
+
+void FileSystem::sweepCold() {
+    Timestamp t = currentTimestamp();
+    for (File* file : allFiles()) {
+        file->compressCold(t, cold_age, cold_depth);
+    }
+}
+
+void FileSystem::setAutoGc(long long every_changes, int keep_last) {
+    gc_every = every_changes;
+    gc_keep_last = keep_last;
 }
 
-void FileSystem::SNAPSHOT(const string& filename, const string& message) {
-    File** file_ptr = files->get(filename);
-    if (file_ptr == nullptr) {
-        cerr << "Error: File '" << filename << "' not found." << endl;
+void FileSystem::setColdStorage(long long max_age_seconds, int max_distance) {
+    cold_age = max_age_seconds;
+    cold_depth = max_distance;
+}
+
+// Callers hold the lock of the filename's shard.
+File* FileSystem::addFile(const string& filename, size_t name_hash, Timestamp t, int id) {
+    File* new_file = new File(filename, t, id, blobs);
+    shardFor(name_hash).files.INSERT(filename, new_file, name_hash);
+    if (search_built) {
+        indexFile(new_file);
+    }
+    {
+        unique_lock<shared_mutex> naming(name_lock);
+        file_names.INSERT(new_file->getFilename(), new_file);
+    }
+    lock_guard<mutex> guard(rank_lock);
+    if (!dirty_files.empty()) {
+        heaps_stale = true;
+    }
+    recentFiles->INSERT(id, new_file);
+    biggestTree->INSERT(id, new_file);
+    if (id >= static_cast<int>(files_by_id.size())) {
+        files_by_id.resize(id + 1, nullptr);
+    }
+    files_by_id[id] = new_file;
+    return new_file;
+}
+
+// Called with the changed file locked, so each file's records reach the log in
+// the order its changes were applied.
+void FileSystem::logRecord(LogOp op, Timestamp t, const string& filename, string_view text,
+                           int version_id, int other_version_id) {
+    if (wal == nullptr) {
         return;
     }
-    (*file_ptr)->SNAPSHOT(message, time(0));
+    STATS_ONLY(LatencyTimer timing(stage_latency[STAGE_LOG]);)
+    lock_guard<mutex> guard(wal_lock);
+    wal->append(op, static_cast<int64_t>(t), filename, text, version_id, other_version_id);
+    if (wal->recordsSinceReset() >= checkpoint_every) {
+        checkpoint_due = true;
+    }
 }
 
-void FileSystem::ROLLBACK(const string& filename, int versionID) {
-    File** file_ptr = files->get(filename);
-    if (file_ptr == nullptr) {
-        cerr << "Error: File '" << filename << "' not found." << endl;
+void FileSystem::CREATE(const string& filename, ostream& out, ostream& err) {
+    STATS_ONLY(LatencyTimer timing(command_latency[STAT_CREATE]);)
+    {
+        shared_lock<shared_mutex> running(maintenance_lock);
+        size_t name_hash = nameHash(filename);
+        FileShard& shard = shardFor(name_hash);
+        unique_lock<shared_mutex> creating(shard.lock);
+        if (shard.files.get(filename, name_hash) != nullptr) {
+            err << "Error: File '" << filename << "' already exists." << endl;
+            return;
+        }
+        Timestamp t = now();
+        File* file = addFile(filename, name_hash, t, num_files++);
+        logRecord(LOG_CREATE, t, filename);
+        modifications.add(Modification{t, file->getId(), 0, LOG_CREATE});
+        out << "File '" << filename << "' created with snapshot version 0." << '\n';
+    }
+    runMaintenance();
+}
+
+void FileSystem::READ(const string& filename, ostream& out, ostream& err) {
+    STATS_ONLY(LatencyTimer timing(command_latency[STAT_READ]);)
+    shared_lock<shared_mutex> running(maintenance_lock);
+    File* file = findFile(filename);
+    if (file == nullptr) {
+        err << "Error: File '" << filename << "' not found." << endl;
         return;
     }
-    if ((*file_ptr)->ROLLBACK(versionID)) {
-        cout << "Active version for '" << filename << "' set to " << (*file_ptr)->ActiveVersionId() << "." << endl;
-    } else {
-        if (versionID == -1) {
-            cerr << "Error: Cannot ROLLBACK from root version." << endl;
+    shared_lock<shared_mutex> reading(file->accessLock());
+    STATS_ONLY(LatencyTimer materialising(stage_latency[STAGE_CONTENT]);)
+    string_view content;
+    if (!file->READ(content)) {
+        err << "Error: Stored content of '" << filename << "' does not decode." << endl;
+        return;
+    }
+    STATS_ONLY(materialising.stop(); bytes_read += content.size(); LatencyTimer writing(stage_latency[STAGE_OUTPUT]);)
+    out << content << '\n';
+}
+
+void FileSystem::INSERT(const string& filename, string_view content, ostream& out, ostream& err) {
+    STATS_ONLY(LatencyTimer timing(command_latency[STAT_INSERT]);)
+    {
+        shared_lock<shared_mutex> running(maintenance_lock);
+        File* file = findFile(filename);
+        if (file == nullptr) {
+            err << "Error: File '" << filename << "' not found." << endl;
+            return;
+        }
+        unique_lock<shared_mutex> writing(file->accessLock());
+        int parent_id = file->ActiveVersionId();
+        Timestamp t = now();
+        bool created = file->INSERT(content, t);
+        STATS_ONLY(bytes_written += content.size();)
+        touchHeaps(file);
+        indexChange(file, LOG_INSERT, content, parent_id, created);
+        logRecord(LOG_INSERT, t, filename, content);
+        noteChange(file, LOG_INSERT, t);
+        if (created) {
+            out << "New version " << file->ActiveVersionId() << " created for '" << filename << "'. Parent is version " << parent_id << "." << '\n';
+        } else {
+            out << "Content inserted into active version " << file->ActiveVersionId() << " of '" << filename << "'." << '\n';
+        }
+    }
+    runMaintenance();
+}
+
+// The content moves into the file, and the index and log read it back from there.
+void FileSystem::UPDATE(const string& filename, string content, ostream& out, ostream& err) {
+    STATS_ONLY(LatencyTimer timing(command_latency[STAT_UPDATE]);)
+    {
+        shared_lock<shared_mutex> running(maintenance_lock);
+        File* file = findFile(filename);
+        if (file == nullptr) {
+            err << "Error: File '" << filename << "' not found." << endl;
+            return;
+        }
+        unique_lock<shared_mutex> writing(file->accessLock());
+        int parent_id = file->ActiveVersionId();
+        Timestamp t = now();
+        bool created = file->UPDATE(std::move(content), t);
+        // The new content is held uncompressed, so it always reads back.
+        string_view stored;
+        file->READ(stored);
+        STATS_ONLY(bytes_written += stored.size();)
+        touchHeaps(file);
+        indexChange(file, LOG_UPDATE, stored, parent_id, created);
+        logRecord(LOG_UPDATE, t, filename, stored);
+        noteChange(file, LOG_UPDATE, t);
+        if (created) {
+            out << "New version " << file->ActiveVersionId() << " created for '" << filename << "'. Parent is version " << parent_id << "." << '\n';
+        } else {
+            out << "Content updated for active version " << file->ActiveVersionId() << " of '" << filename << "'." << '\n';
+        }
+    }
+    runMaintenance();
+}
+
+void FileSystem::SNAPSHOT(const string& filename, const string& message, ostream& out, ostream& err) {
+    STATS_ONLY(LatencyTimer timing(command_latency[STAT_SNAPSHOT]);)
+    {
+        shared_lock<shared_mutex> running(maintenance_lock);
+        File* file = findFile(filename);
+        if (file == nullptr) {
+            err << "Error: File '" << filename << "' not found." << endl;
+            return;
+        }
+        unique_lock<shared_mutex> writing(file->accessLock());
+        Timestamp t = now();
+        if (file->SNAPSHOT(message, t)) {
+            indexChange(file, LOG_SNAPSHOT, message, -1, false);
+            logRecord(LOG_SNAPSHOT, t, filename, message);
+            out << "Snapshot created for active version " << file->ActiveVersionId() << " of '" << filename << "'." << '\n';
+            noteChange(file, LOG_SNAPSHOT, t);
         } else {
-            cerr << "Error: Version ID " << versionID << " not found for file '" << filename << "'." << endl;
+            out << "Warning: Version " << file->ActiveVersionId() << " is already a snapshot." << '\n';
+        }
+    }
+    runMaintenance();
+}
+
+void FileSystem::ROLLBACK(const string& filename, int versionID, ostream& out, ostream& err) {
+    STATS_ONLY(LatencyTimer timing(command_latency[STAT_ROLLBACK]);)
+    {
+        shared_lock<shared_mutex> running(maintenance_lock);
+        File* file = findFile(filename);
+        if (file == nullptr) {
+            err << "Error: File '" << filename << "' not found." << endl;
+            return;
         }
+        unique_lock<shared_mutex> writing(file->accessLock());
+        Timestamp t = now();
+        if (file->ROLLBACK(versionID, t)) {
+            indexChange(file, LOG_ROLLBACK, "", -1, false);
+            logRecord(LOG_ROLLBACK, t, filename, "", versionID);
+            out << "Active version for '" << filename << "' set to " << file->ActiveVersionId() << "." << '\n';
+            noteChange(file, LOG_ROLLBACK, t);
+        } else {
+            if (versionID == -1) {
+                err << "Error: Cannot ROLLBACK from root version." << endl;
+            } else {
+                err << "Error: Version ID " << versionID << " not found for file '" << filename << "'." << endl;
+            }
+        }
+    }
+    runMaintenance();
+}
+
+void FileSystem::HISTORY(const string& filename, ostream& out, ostream& err) {
+    STATS_ONLY(LatencyTimer timing(command_latency[STAT_HISTORY]);)
+    shared_lock<shared_mutex> running(maintenance_lock);
+    File* file = findFile(filename);
+    if (file == nullptr) {
+        err << "Error: File '" << filename << "' not found." << endl;
+        return;
+    }
+    shared_lock<shared_mutex> reading(file->accessLock());
+    STATS_ONLY(LatencyTimer writing(stage_latency[STAGE_OUTPUT]);)
+    file->HISTORY(out);
+}
+
+void FileSystem::DIFF(const string& filename, int versionA, int versionB, ostream& out, ostream& err) {
+    STATS_ONLY(LatencyTimer timing(command_latency[STAT_DIFF]);)
+    shared_lock<shared_mutex> running(maintenance_lock);
+    File* file = findFile(filename);
+    if (file == nullptr) {
+        err << "Error: File '" << filename << "' not found." << endl;
+        return;
+    }
+    shared_lock<shared_mutex> reading(file->accessLock());
+    if (!file->HasVersion(versionA) || !file->HasVersion(versionB)) {
+        err << "Error: Version ID " << versionA << " or " << versionB << " not found for file '" << filename << "'." << endl;
+        return;
+    }
+    if (!file->DIFF(versionA, versionB, out)) {
+        err << "Error: Stored content of '" << filename << "' does not decode." << endl;
+    }
+}
+
+void FileSystem::MERGE(const string& filename, int versionA, int versionB, ostream& out, ostream& err) {
+    STATS_ONLY(LatencyTimer timing(command_latency[STAT_MERGE]);)
+    {
+        shared_lock<shared_mutex> running(maintenance_lock);
+        File* file = findFile(filename);
+        if (file == nullptr) {
+            err << "Error: File '" << filename << "' not found." << endl;
+            return;
+        }
+        unique_lock<shared_mutex> writing(file->accessLock());
+        Timestamp t = now();
+        int base_id = 0, conflicts = 0;
+        if (!file->IsSnapshot(versionA) || !file->IsSnapshot(versionB)) {
+            err << "Error: Versions " << versionA << " and " << versionB << " must both be snapshots of file '" << filename << "'." << endl;
+            return;
+        }
+        if (!file->MERGE(versionA, versionB, t, base_id, conflicts)) {
+            err << "Error: Stored content of '" << filename << "' does not decode." << endl;
+            return;
+        }
+        touchHeaps(file);
+        indexChange(file, LOG_MERGE, "", -1, true);
+        logRecord(LOG_MERGE, t, filename, "", versionA, versionB);
+        out << "Merged version " << file->ActiveVersionId() << " created for '" << filename << "' from versions "
+            << versionA << " and " << versionB << " (common ancestor: version " << base_id << ")." << '\n';
+        if (conflicts > 0) {
+            out << "Warning: " << conflicts << " conflicting region(s) marked in version " << file->ActiveVersionId() << "." << '\n';
+        }
+        noteChange(file, LOG_MERGE, t);
+    }
+    runMaintenance();
+}
+
+void FileSystem::TAG(const string& filename, int versionID, ostream& out, ostream& err) {
+    STATS_ONLY(LatencyTimer timing(command_latency[STAT_TAG]);)
+    {
+        shared_lock<shared_mutex> running(maintenance_lock);
+        File* file = findFile(filename);
+        if (file == nullptr) {
+            err << "Error: File '" << filename << "' not found." << endl;
+            return;
+        }
+        unique_lock<shared_mutex> writing(file->accessLock());
+        if (!file->TAG(versionID)) {
+            err << "Error: Version ID " << versionID << " is not a snapshot of file '" << filename << "'." << endl;
+            return;
+        }
+        logRecord(LOG_TAG, now(), filename, "", versionID);
+        out << "Version " << versionID << " of '" << filename << "' tagged; garbage collection will keep it." << '\n';
+    }
+    runMaintenance();
+}
+
+void FileSystem::AS_OF_READ(Timestamp t, const string& filename, ostream& out, ostream& err) {
+    STATS_ONLY(LatencyTimer timing(command_latency[STAT_AS_OF]);)
+    shared_lock<shared_mutex> running(maintenance_lock);
+    File* file = findFile(filename);
+    if (file == nullptr) {
+        err << "Error: File '" << filename << "' not found." << endl;
+        return;
+    }
+    shared_lock<shared_mutex> reading(file->accessLock());
+    int version_id = file->VersionAt(t);
+    if (version_id < 0) {
+        err << "Error: File '" << filename << "' did not exist at " << formatTimestamp(t) << "." << endl;
+        return;
+    }
+    ContentReader content;
+    Timestamp modified = 0;
+    if (!file->openVersion(version_id, content, modified)) {
+        err << "Error: Version " << version_id << " of '" << filename << "', active at " << formatTimestamp(t)
+            << ", was removed by garbage collection." << endl;
+        return;
+    }
+    if (modified > t) {
+        err << "Warning: Version " << version_id << " was modified after " << formatTimestamp(t)
+            << "; showing its latest content." << endl;
+    }
+    string_view chunk;
+    while (content.next(chunk)) {
+        out << chunk;
+    }
+    out << '\n';
+    if (content.corrupt()) {
+        err << "Error: Stored content of version " << version_id << " of '" << filename << "' does not decode; the output above is cut short." << endl;
     }
 }
 
-void FileSystem::HISTORY(const string& filename) {
-    File** file_ptr = files->get(filename);
-    if (file_ptr == nullptr) {
-        cerr << "Error: File '" << filename << "' not found." << endl;
+void FileSystem::CHANGED_BETWEEN(Timestamp t1, Timestamp t2, ostream& out, ostream& err) {
+    STATS_ONLY(LatencyTimer timing(command_latency[STAT_CHANGED_BETWEEN]);)
+    if (t1 > t2) {
+        err << "Error: The start of the range is after its end." << endl;
+        return;
+    }
+    shared_lock<shared_mutex> running(maintenance_lock);
+    vector<Modification> changes;
+    modifications.range(t1, t2, changes);
+
+    struct FileChanges {
+        int file_id;
+        int count;
+        Timestamp last;
+        int version_id;
+    };
+    vector<FileChanges> summary;
+    HashMap<int, int> position; // file id -> index in summary
+    for (const Modification& change : changes) {
+        int* index = position.get(change.file_id);
+        if (index == nullptr) {
+            position.INSERT(change.file_id, summary.size());
+            summary.push_back(FileChanges{change.file_id, 0, 0, 0});
+            index = position.get(change.file_id);
+        }
+        FileChanges& entry = summary[*index];
+        entry.count++;
+        entry.last = change.time;
+        entry.version_id = change.version_id;
+    }
+    sort(summary.begin(), summary.end(), [](const FileChanges& a, const FileChanges& b) { return a.last > b.last; });
+
+    out << "Files changed between " << formatTimestamp(t1) << " and " << formatTimestamp(t2) << ":" << '\n';
+    if (summary.empty()) {
+        out << "  No changes." << '\n';
         return;
     }
-    (*file_ptr)->HISTORY();
+    lock_guard<mutex> guard(rank_lock);
+    for (const FileChanges& entry : summary) {
+        out << "  - " << files_by_id[entry.file_id]->getFilename() << " (" << entry.count << " change(s), last at "
+            << formatTimestamp(entry.last) << ", leaving version " << entry.version_id << " active)" << '\n';
+    }
 }
 
-void FileSystem::RECENT_FILES(int num) {
-    MaxHeap<File*, ChangeT> temp_heap = *recentFiles;
-    cout << "Most Recently Modified Files:" << endl;
-    int count = 0;
-    while (!temp_heap.isEmpty() && (num == -1 || count < num)) {
-        File* file = temp_heap.extractMax();
-        time_t mod_time = file->LastChangeT();
-        tm* ptm = localtime(&mod_time);
+void FileSystem::GC(int keep_last, ostream& out) {
+    STATS_ONLY(LatencyTimer timing(command_latency[STAT_GC]);)
+    {
+        unique_lock<shared_mutex> exclusive(maintenance_lock);
+        GcStats stats = collectGarbage(keep_last);
+        out << "Garbage collection removed " << stats.working_removed << " working version(s) and "
+            << stats.snapshots_removed << " snapshot(s), releasing " << stats.bytes_released << " bytes of content." << '\n';
+    }
+    runMaintenance();
+}
+
+void FileSystem::RECENT_FILES(int num, ostream& out) {
+    STATS_ONLY(LatencyTimer timing(command_latency[STAT_RECENT_FILES]);)
+    shared_lock<shared_mutex> running(maintenance_lock);
+    vector<File*> top_files;
+    {
+        lock_guard<mutex> guard(rank_lock);
+        flushHeaps();
+        top_files = recentFiles->topK(num);
+    }
+    out << "Most Recently Modified Files:" << '\n';
+    for (File* file : top_files) {
+        time_t mod_time = toTimeT(file->LastChangeT());
+        tm local;
+        localtime_r(&mod_time, &local);
         stringstream ss;
-        ss << put_time(ptm, "%a %b %d %H:%M:%S %Y");
-        cout << "  - " << file->getFilename() << " (Last modified: " << ss.str() << ")" << endl;
-        count++;
+        ss << put_time(&local, "%a %b %d %H:%M:%S %Y");
+        out << "  - " << file->getFilename() << " (Last modified: " << ss.str() << ")" << '\n';
+    }
+}
+
+void FileSystem::BIGGEST_TREES(int num, ostream& out) {
+    STATS_ONLY(LatencyTimer timing(command_latency[STAT_BIGGEST_TREES]);)
+    shared_lock<shared_mutex> running(maintenance_lock);
+    vector<File*> top_files;
+    {
+        lock_guard<mutex> guard(rank_lock);
+        flushHeaps();
+        top_files = biggestTree->topK(num);
+    }
+    out << "Files with Most Versions:" << '\n';
+    for (File* file : top_files) {
+        out << "  - " << file->getFilename() << " (" << file->TotalVersions() << " versions)" << '\n';
+    }
+}
+
+void FileSystem::BLOB_STATS(ostream& out) {
+    STATS_ONLY(LatencyTimer timing(command_latency[STAT_BLOB_STATS]);)
+    shared_lock<shared_mutex> running(maintenance_lock);
+    BlobStoreStats blob = blobs->stats();
+    out << "Blob Store Statistics:" << '\n';
+    out << "  Unique blobs: " << blob.unique_blobs << '\n';
+    out << "  References: " << blob.references << '\n';
+    out << "  Logical bytes: " << blob.logical_bytes << '\n';
+    out << "  Stored bytes: " << blob.stored_bytes << '\n';
+    out << "  Bytes saved: " << blob.bytesSaved() << '\n';
+    out << "  Dedup ratio: " << fixed << setprecision(2) << blob.dedupRatio() << defaultfloat << '\n';
+    out << "  Compressed blobs: " << blob.compressed_blobs << " (" << blob.compressed_raw_bytes << " bytes stored in "
+        << blob.compressed_stored_bytes << ")" << '\n';
+    out << "  Compression ratio: " << fixed << setprecision(2) << blob.compressionRatio() << defaultfloat << '\n';
+    out << "  Decompressions: " << blob.decompressions << " (average " << fixed << setprecision(2)
+        << blob.averageDecompressMicros() << defaultfloat << " us)" << '\n';
+}
+
+void FileSystem::CHECKPOINT(ostream& out, ostream& err) {
+    STATS_ONLY(LatencyTimer timing(command_latency[STAT_CHECKPOINT]);)
+    unique_lock<shared_mutex> exclusive(maintenance_lock);
+    if (wal == nullptr) {
+        err << "Error: No data directory is open; nothing to checkpoint." << endl;
+        return;
+    }
+    if (writeCheckpoint()) {
+        out << "Checkpoint written at log sequence number " << checkpoint_lsn << "." << '\n';
+    }
+}
+
+void FileSystem::SEARCH(bool all_history, const string& query, ostream& out, ostream& err) {
+    STATS_ONLY(LatencyTimer timing(command_latency[STAT_SEARCH]);)
+    vector<string> terms = SearchIndex::words(query);
+    if (terms.empty()) {
+        err << "Error: The search query has no words to look for." << endl;
+        return;
+    }
+    shared_lock<shared_mutex> running(maintenance_lock);
+    if (!search_built) {
+        running.unlock();
+        {
+            unique_lock<shared_mutex> exclusive(maintenance_lock);
+            buildSearchIndex();
+        }
+        running.lock();
+    }
+    vector<SearchHit> hits;
+    search_index.search(terms, all_history, hits);
+
+    out << (all_history ? "Versions" : "Files") << " matching '" << query << "':" << '\n';
+    if (hits.empty()) {
+        out << "  No matches." << '\n';
+        return;
+    }
+    lock_guard<mutex> guard(rank_lock);
+    for (size_t i = 0; i < hits.size(); ) {
+        out << "  - " << files_by_id[hits[i].file_id]->getFilename() << (all_history ? " (versions " : " (version ")
+            << hits[i].version_id;
+        size_t j = i + 1;
+        for (; j < hits.size() && hits[j].file_id == hits[i].file_id; ++j) {
+            out << ", " << hits[j].version_id;
+        }
+        out << ")" << '\n';
+        i = j;
     }
 }
 
-void FileSystem::BIGGEST_TREES(int num) {
-    MaxHeap<File*, VersionCount> temp_heap = *biggestTree;
-    cout << "Files with Most Versions:" << endl;
-    int count = 0;
-    while (!temp_heap.isEmpty() && (num == -1 || count < num)) {
-        File* file = temp_heap.extractMax();
-        cout << "  - " << file->getFilename() << " (" << file->TotalVersions() << " versions)" << endl;
-        count++;
+// One descent to the first name not below the prefix, then a walk along the
+// leaves until a name no longer has the prefix.
+void FileSystem::LS(const string& prefix, int limit, ostream& out) {
+    STATS_ONLY(LatencyTimer timing(command_latency[STAT_LS]);)
+    vector<File*> listed;
+    {
+        shared_lock<shared_mutex> reading(name_lock);
+        file_names.scanFrom(prefix, [&](string_view name, File* file) {
+            if (name.compare(0, prefix.size(), prefix) != 0 || static_cast<int>(listed.size()) == limit) {
+                return false;
+            }
+            listed.push_back(file);
+            return true;
+        });
     }
+    out << "Files under '" << prefix << "':" << '\n';
+    if (listed.empty()) {
+        out << "  No files." << '\n';
+    }
+    for (File* file : listed) {
+        out << "  - " << file->getFilename() << " (" << file->TotalVersions() << " versions, last changed "
+            << formatTimestamp(file->LastChangeT()) << ")" << '\n';
+    }
+}
+
+#ifdef TTFS_STATS
+static const char* const STAT_COMMAND_NAMES[NUM_STAT_COMMANDS] = {
+    "CREATE", "READ", "INSERT", "UPDATE", "SNAPSHOT", "ROLLBACK", "HISTORY", "DIFF", "MERGE", "TAG", "AS_OF",
+    "CHANGED_BETWEEN", "GC", "RECENT_FILES", "BIGGEST_TREES", "BLOB_STATS", "CHECKPOINT", "SEARCH", "LS", "STATS"};
+
+static const char* const STAT_STAGE_NAMES[NUM_STAT_STAGES] = {
+    "lookup", "ranking", "content", "output", "log", "maintenance", "flush"};
+
+// Latencies are reported in microseconds.
+static void printLatency(const char* name, const LatencyHistogram& histogram, bool json, bool first, ostream& out) {
+    if (json) {
+        out << (first ? "" : ",") << '"' << name << "\":{\"count\":" << histogram.count() << ",\"mean_us\":"
+            << histogram.mean() / 1000 << ",\"p50_us\":" << histogram.percentile(0.50) / 1000.0 << ",\"p90_us\":"
+            << histogram.percentile(0.90) / 1000.0 << ",\"p99_us\":" << histogram.percentile(0.99) / 1000.0
+            << ",\"max_us\":" << histogram.max() / 1000.0 << '}';
+        return;
+    }
+    out << "  " << left << setw(16) << name << right << setw(10) << histogram.count() << setw(12)
+        << histogram.mean() / 1000 << setw(12) << histogram.percentile(0.50) / 1000.0 << setw(12)
+        << histogram.percentile(0.90) / 1000.0 << setw(12) << histogram.percentile(0.99) / 1000.0 << setw(12)
+        << histogram.max() / 1000.0 << '\n';
+}
+
+LatencyHistogram& FileSystem::stageLatency(StatStage stage) {
+    return stage_latency[stage];
 }
+#endif
+
+// Holds off every command so memory and table shapes are read at one instant.
+void FileSystem::STATS(bool json, ostream& out, ostream& err) {
+#ifndef TTFS_STATS
+    (void)json;
+    (void)out;
+    err << "Error: This build has no instrumentation; compile with -DTTFS_STATS." << endl;
+#else
+    (void)err;
+    LatencyTimer timing(command_latency[STAT_STATS]);
+    unique_lock<shared_mutex> exclusive(maintenance_lock);
+    FileMemoryStats memory{0, 0, 0, 0};
+    vector<File*> all_files = allFiles();
+    for (File* file : all_files) {
+        file->addMemoryStats(memory);
+    }
+    HashMapStats table{0, 0, 0, 0, 0, 0};
+    for (int i = 0; i < FILE_SHARDS; ++i) {
+        HashMapStats shard = shards[i].files.probeStats();
+        table.entries += shard.entries;
+        table.capacity += shard.capacity;
+        table.total_probe += shard.total_probe;
+        table.max_probe = shard.max_probe > table.max_probe ? shard.max_probe : table.max_probe;
+        table.lookups += shard.lookups;
+        table.probes += shard.probes;
+    }
+    double mean_probe = table.entries == 0 ? 0 : static_cast<double>(table.total_probe) / table.entries;
+    double probes_per_lookup = table.lookups == 0 ? 0 : static_cast<double>(table.probes) / table.lookups;
 
+    out << fixed << setprecision(2);
+    if (json) {
+        out << "{\"commands\":{";
+        bool first = true;
+        for (int i = 0; i < NUM_STAT_COMMANDS; ++i) {
+            if (command_latency[i].count() > 0) {
+                printLatency(STAT_COMMAND_NAMES[i], command_latency[i], true, first, out);
+                first = false;
+            }
+        }
+        out << "},\"stages\":{";
+        for (int i = 0; i < NUM_STAT_STAGES; ++i) {
+            printLatency(STAT_STAGE_NAMES[i], stage_latency[i], true, i == 0, out);
+        }
+        out << "},\"content\":{\"bytes_written\":" << bytes_written << ",\"bytes_read\":" << bytes_read << '}'
+            << ",\"memory\":{\"files\":" << all_files.size() << ",\"version_nodes\":" << memory.nodes
+            << ",\"arena_bytes\":" << memory.arena_bytes << ",\"working_bytes\":" << memory.working_bytes
+            << ",\"cached_bytes\":" << memory.cached_bytes << ",\"blob_bytes\":" << blobs->stats().stored_bytes << '}'
+            << ",\"file_table\":{\"entries\":" << table.entries << ",\"slots\":" << table.capacity
+            << ",\"mean_probe\":" << mean_probe << ",\"max_probe\":" << table.max_probe << ",\"lookups\":"
+            << table.lookups << ",\"probes_per_lookup\":" << probes_per_lookup << '}'
+            << ",\"heap_rebuilds\":" << heap_rebuilds << "}\n";
+    } else {
+        out << "Command Latency (us):" << '\n';
+        out << "  " << left << setw(16) << "command" << right << setw(10) << "count" << setw(12) << "mean" << setw(12)
+            << "p50" << setw(12) << "p90" << setw(12) << "p99" << setw(12) << "max" << '\n';
+        for (int i = 0; i < NUM_STAT_COMMANDS; ++i) {
+            if (command_latency[i].count() > 0) {
+                printLatency(STAT_COMMAND_NAMES[i], command_latency[i], false, false, out);
+            }
+        }
+        out << "Stage Latency (us):" << '\n';
+        for (int i = 0; i < NUM_STAT_STAGES; ++i) {
+            printLatency(STAT_STAGE_NAMES[i], stage_latency[i], false, false, out);
+        }
+        out << "Content:" << '\n';
+        out << "  Bytes written: " << bytes_written << '\n';
+        out << "  Bytes read: " << bytes_read << '\n';
+        out << "Memory:" << '\n';
+        out << "  Files: " << all_files.size() << '\n';
+        out << "  Version nodes: " << memory.nodes << '\n';
+        out << "  Arena bytes: " << memory.arena_bytes << '\n';
+        out << "  Working delta bytes: " << memory.working_bytes << '\n';
+        out << "  Cached content bytes: " << memory.cached_bytes << '\n';
+        out << "  Blob store bytes: " << blobs->stats().stored_bytes << '\n';
+        out << "File Table:" << '\n';
+        out << "  Entries: " << table.entries << " in " << table.capacity << " slots" << '\n';
+        out << "  Probe distance: mean " << mean_probe << ", max " << table.max_probe << '\n';
+        out << "  Lookups: " << table.lookups << " (" << probes_per_lookup << " slots inspected each)" << '\n';
+        out << "Heap rebuilds: " << heap_rebuilds << '\n';
+    }
+    out << defaultfloat;
+#endif
+}
+
+bool FileSystem::openStorage(const string& dir, long long checkpoint_interval) {
+    if (wal != nullptr) {
+        cerr << "Error: Storage is already open in '" << data_dir << "'." << endl;
+        return false;
+    }
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        cerr << "Error: Could not create data directory '" << dir << "'." << endl;
+        return false;
+    }
+    data_dir = dir;
+    checkpoint_every = checkpoint_interval;
+    if (!loadCheckpoint()) {
+        return false;
+    }
+
+    vector<LogRecord> records;
+    string log_path = data_dir + "/wal.log";
+    if (!WriteAheadLog::recover(log_path, records)) {
+        return false;
+    }
+    uint64_t last_lsn = checkpoint_lsn;
+    for (const LogRecord& record : records) {
+        if (record.lsn <= checkpoint_lsn) {
+            continue;
+        }
+        if (!applyRecord(record)) {
+            cerr << "Warning: Could not replay log record " << record.lsn << " for '" << record.filename << "'." << endl;
+        }
+        last_lsn = record.lsn;
+    }
+
+    wal = new WriteAheadLog(log_path);
+    if (!wal->open(last_lsn + 1)) {
+        delete wal;
+        wal = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool FileSystem::openReplica(const string& dir) {
+    if (wal != nullptr || image != nullptr) {
+        cerr << "Error: Storage is already open in '" << data_dir << "'." << endl;
+        return false;
+    }
+    data_dir = dir;
+    return loadCheckpoint();
+}
+
+bool FileSystem::applyRecord(const LogRecord& record) {
+    shared_lock<shared_mutex> running(maintenance_lock);
+    Timestamp t = record.timestamp;
+    Timestamp last = system_clock.load();
+    while (t > last && !system_clock.compare_exchange_weak(last, t)) {
+    }
+    size_t name_hash = nameHash(record.filename);
+    if (record.op == LOG_CREATE) {
+        FileShard& shard = shardFor(name_hash);
+        unique_lock<shared_mutex> creating(shard.lock);
+        if (shard.files.get(record.filename, name_hash) != nullptr) {
+            return false;
+        }
+        File* file = addFile(record.filename, name_hash, t, num_files++);
+        modifications.add(Modification{t, file->getId(), 0, LOG_CREATE});
+        return true;
+    }
+    File* file = findFile(record.filename, name_hash);
+    if (file == nullptr) {
+        return false;
+    }
+    unique_lock<shared_mutex> writing(file->accessLock());
+    int parent_id = file->ActiveVersionId();
+    bool created = false;
+    switch (record.op) {
+        case LOG_INSERT:
+            created = file->INSERT(record.text, t);
+            break;
+        case LOG_UPDATE:
+            created = file->UPDATE(record.text, t);
+            break;
+        case LOG_SNAPSHOT:
+            if (!file->SNAPSHOT(record.text, t)) {
+                return false;
+            }
+            break;
+        case LOG_ROLLBACK:
+            if (!file->ROLLBACK(record.version_id, t)) {
+                return false;
+            }
+            break;
+        case LOG_MERGE: {
+            int base_id = 0, conflicts = 0;
+            if (!file->MERGE(record.version_id, record.other_version_id, t, base_id, conflicts)) {
+                return false;
+            }
+            break;
+        }
+        case LOG_TAG:
+            return file->TAG(record.version_id);
+        case LOG_GC: {
+            GcStats stats{0, 0, 0};
+            file->GC(record.version_id, stats);
+            touchHeaps(file);
+            indexChange(file, LOG_GC, "", -1, false);
+            return true;
+        }
+        default:
+            return false;
+    }
+    touchHeaps(file);
+    indexChange(file, record.op, record.text, parent_id, created);
+    modifications.add(Modification{t, file->getId(), file->ActiveVersionId(), record.op});
+    return true;
+}
+
+uint64_t FileSystem::checkpointLsn() const {
+    return checkpoint_lsn;
+}
+
+Timestamp FileSystem::latestChange() const {
+    return system_clock;
+}
+
+// Maps the latest checkpoint image. Files are served from it in place and only
+// build their version trees when first modified, so startup does not depend on
+// the size of the history.
+bool FileSystem::loadCheckpoint() {
+    string path = data_dir + "/checkpoint.img";
+    bool missing = false;
+    image = SnapshotImage::open(path, missing);
+    if (image == nullptr) {
+        return missing;
+    }
+    checkpoint_lsn = image->lsn();
+    modifications.attachImage(image);
+    for (uint32_t i = 0; i < image->fileCount(); ++i) {
+        File* file = File::fromImage(image, i, blobs);
+        if (file == nullptr) {
+            cerr << "Error: Checkpoint image '" << path << "' is corrupt." << endl;
+            return false;
+        }
+        size_t name_hash = nameHash(file->getFilename());
+        shardFor(name_hash).files.INSERT(file->getFilename(), file, name_hash);
+        file_names.INSERT(file->getFilename(), file);
+        recentFiles->INSERT(file->getId(), file);
+        biggestTree->INSERT(file->getId(), file);
+        if (file->getId() >= num_files) {
+            num_files = file->getId() + 1;
+            files_by_id.resize(num_files, nullptr);
+        }
+        files_by_id[file->getId()] = file;
+        if (file->LastChangeT() > system_clock) {
+            system_clock = file->LastChangeT();
+        }
+    }
+    return true;
+}
+
+// Runs with maintenance_lock held exclusively, so no command is running.
+// The image is written to a temp file and renamed into place, so a crash leaves
+// either the old or the new checkpoint. The log is only reset once the new image
+// is durable; replay skips records it already covers. Files still served from
+// the previous image are re-pointed at the new one before it is unmapped.
+bool FileSystem::writeCheckpoint() {
+    wal->commit();
+    uint64_t lsn = wal->nextLsn() - 1;
+    string path = data_dir + "/checkpoint.img";
+
+    SnapshotImageWriter writer(path);
+    if (!writer.begin()) {
+        return false;
+    }
+    vector<File*> all_files = allFiles();
+    for (File* file : all_files) {
+        if (!file->writeImage(writer)) {
+            cerr << "Error: Stored content of '" << file->getFilename() << "' does not decode; checkpoint not written." << endl;
+            return false;
+        }
+    }
+    modifications.writeImage(writer);
+    if (!writer.finish(lsn)) {
+        return false;
+    }
+    int dir_fd = open(data_dir.c_str(), O_RDONLY);
+    if (dir_fd != -1) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+
+    bool missing = false;
+    SnapshotImage* new_image = SnapshotImage::open(path, missing);
+    if (new_image != nullptr) {
+        for (size_t i = 0; i < all_files.size(); ++i) {
+            if (all_files[i]->isImageBacked()) {
+                all_files[i]->attachImage(new_image, i);
+            }
+        }
+        modifications.attachImage(new_image);
+        delete image;
+        image = new_image;
+    }
+
+    checkpoint_lsn = lsn;
+    return wal->reset();
+}
@@ -2,9 +2,22 @@
 #define FILESYSTEM_HPP
 
 #include "File.hpp"
-#include "../DataStructures/MaxHeap.hpp"
+#include "ModificationIndex.hpp"
+#include "SearchIndex.hpp"
+#include "../DataStructures/IndexedMaxHeap.hpp"
 #include "../DataStructures/HashMap.hpp"
+#include "../DataStructures/BlobStore.hpp"
+#include "../DataStructures/BPlusTree.hpp"
+#include "../DataStructures/Stats.hpp"
+#include "../Storage/WriteAheadLog.hpp"
 #include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
 
 using namespace std;
 
@@ -22,28 +35,194 @@ struct VersionCount {
     }
 };
 
+#ifdef TTFS_STATS
+// What STATS times: every command from start to finish, and the stages inside
+// commands that tend to dominate them.
+enum StatCommand {
+    STAT_CREATE, STAT_READ, STAT_INSERT, STAT_UPDATE, STAT_SNAPSHOT, STAT_ROLLBACK, STAT_HISTORY, STAT_DIFF,
+    STAT_MERGE, STAT_TAG, STAT_AS_OF, STAT_CHANGED_BETWEEN, STAT_GC, STAT_RECENT_FILES, STAT_BIGGEST_TREES,
+    STAT_BLOB_STATS, STAT_CHECKPOINT, STAT_SEARCH, STAT_LS, STAT_STATS, NUM_STAT_COMMANDS
+};
+
+enum StatStage {
+    STAGE_LOOKUP,      // finding a file in the file table
+    STAGE_RANKING,     // keeping the RECENT_FILES and BIGGEST_TREES heaps in order
+    STAGE_CONTENT,     // materialising content for READ
+    STAGE_OUTPUT,      // writing READ and HISTORY output to the stream
+    STAGE_LOG,         // appending to the write-ahead log
+    STAGE_MAINTENANCE, // automatic GC, cold sweeps and checkpoints
+    STAGE_FLUSH,       // flushing stdout, timed by the shell
+    NUM_STAT_STAGES
+};
+#endif
+
+// Every command is safe to call from several threads at once.
+//
+// Locks, always taken in this order:
+//   maintenance_lock  shared by every command; exclusive for whole-system work
+//                     (GC, cold sweeps, checkpoints)
+//   shard lock        guards one shard of the file table
+//   File::accessLock  shared for reads of a file, exclusive for changes to it
+//   rank_lock, wal_lock, name_lock, the modification and search index locks,
+//   the blob store's lock
+// Commands on different files therefore only meet on the short rank and log
+// critical sections. Background work that a command triggers is queued and run
+// by runMaintenance() once the command has released its locks.
 class FileSystem {
 private:
-    HashMap<string, File*>* files;
-    MaxHeap<File*, ChangeT>* recentFiles;
-    MaxHeap<File*, VersionCount>* biggestTree;
-    unsigned long long system_clock;
+    struct FileShard {
+        shared_mutex lock;
+        HashMap<string, File*> files;
+    };
+    static const int FILE_SHARDS = 64;
+
+    BlobStore* blobs;
+    FileShard* shards;
+    IndexedMaxHeap<File*, ChangeT>* recentFiles;
+    IndexedMaxHeap<File*, VersionCount>* biggestTree;
+    atomic<int> num_files;
+    // Last timestamp handed out by now(); see there.
+    atomic<Timestamp> system_clock;
+    ModificationIndex modifications;
+    // Built by the first SEARCH rather than at startup, which would read every
+    // version of every file; until then changes skip it. Only set while
+    // maintenance_lock is held exclusively, so a command holding it shared sees
+    // a settled value.
+    SearchIndex search_index;
+    bool search_built;
+    vector<File*> files_by_id; // guarded by rank_lock
+    // Every file in name order, for LS. Keys view the names the Files own.
+    BPlusTree<string_view, File*> file_names; // guarded by name_lock
+
+    shared_mutex maintenance_lock;
+    mutex rank_lock; // recentFiles, biggestTree and the deferred-ranking state
+    mutex wal_lock;
+    shared_mutex name_lock;
+    atomic<bool> gc_due;
+    atomic<bool> sweep_due;
+    atomic<bool> checkpoint_due;
 
-    void rebuildHeaps();
+    // Durable storage; wal is null while the file system is purely in memory.
+    string data_dir;
+    WriteAheadLog* wal;
+    SnapshotImage* image; // latest checkpoint, mapped; image-backed files read from it
+    uint64_t checkpoint_lsn;
+    long long checkpoint_every;
+
+    // Automatic garbage collection: every gc_every changes (never when 0), a GC
+    // pass runs with gc_keep_last as its retention policy.
+    long long gc_every;
+    int gc_keep_last;
+    atomic<long long> changes_since_gc;
+
+    // Cold-tier compression policy, see File::compressCold; both limits are off
+    // when negative. Versions are swept every COLD_SWEEP_INTERVAL changes.
+    long long cold_age;
+    int cold_depth;
+    atomic<long long> changes_since_sweep;
+
+    // In batch mode heap maintenance is deferred: changed files are collected
+    // here and the heaps are repaired only when a query needs them.
+    bool defer_heaps;
+    vector<File*> dirty_files;
+    vector<char> heap_dirty; // file id -> listed in dirty_files
+    bool heaps_stale;        // files were added while entries were out of order
+
+#ifdef TTFS_STATS
+    LatencyHistogram command_latency[NUM_STAT_COMMANDS];
+    LatencyHistogram stage_latency[NUM_STAT_STAGES];
+    atomic<uint64_t> bytes_written{0}; // content passed to INSERT and UPDATE
+    atomic<uint64_t> bytes_read{0};    // content returned by READ
+    atomic<uint64_t> heap_rebuilds{0};
+#endif
+
+    // A name is hashed once per command; the hash picks its shard and is then
+    // reused for the probe into that shard's table. Every shard's table hashes
+    // names alike, so the first one computes it.
+    size_t nameHash(const string& filename) const;
+    FileShard& shardFor(size_t name_hash) const;
+    File* findFile(const string& filename);
+    File* findFile(const string& filename, size_t name_hash);
+    vector<File*> allFiles() const;
+    void touchHeaps(File* file);
+    void flushHeaps();
+    Timestamp now();
+    void noteChange(File* file, LogOp op, Timestamp t);
+    void indexFile(File* file);
+    void buildSearchIndex();
+    void indexChange(File* file, LogOp op, string_view text, int parent_id, bool created);
+    void runMaintenance();
+    GcStats collectGarbage(int keep_last);
+    void sweepCold();
+    File* addFile(const string& filename, size_t name_hash, Timestamp t, int id);
+    void logRecord(LogOp op, Timestamp t, const string& filename, string_view text = string_view(),
+                   int version_id = -1, int other_version_id = -1);
+    bool loadCheckpoint();
+    bool writeCheckpoint();
 
 public:
     FileSystem();
     ~FileSystem();
 
-    void CREATE(const string& filename);
-    void READ(const string& filename);
-    void INSERT(const string& filename, const string& content);
-    void UPDATE(const string& filename, const string& content);
-    void SNAPSHOT(const string& filename, const string& message);
-    void ROLLBACK(const string& filename, int versionID = -1);
-    void HISTORY(const string& filename);
-    void RECENT_FILES(int num);
-    void BIGGEST_TREES(int num);
+    // Makes the file system durable in `dir`: loads the latest checkpoint, replays
+    // the write-ahead log written since, and logs every later change. A checkpoint
+    // is taken automatically every `checkpoint_interval` logged changes.
+    bool openStorage(const string& dir, long long checkpoint_interval = 10000);
+    // Loads the latest checkpoint in `dir` without taking the directory over:
+    // nothing is logged and no checkpoints are written. Followers use this and
+    // then apply the primary's log records after checkpointLsn() themselves.
+    bool openReplica(const string& dir);
+    // Applies one logged change, stamped as it was originally. Takes the same
+    // locks as the commands, so records can be applied while commands run.
+    bool applyRecord(const LogRecord& record);
+    uint64_t checkpointLsn() const;
+    // Timestamp of the latest change made, replayed or loaded.
+    Timestamp latestChange() const;
+    void setAutoGc(long long every_changes, int keep_last);
+    void setColdStorage(long long max_age_seconds, int max_distance);
+    // Between beginBatch() and endBatch() the RECENT_FILES and BIGGEST_TREES
+    // heaps are only brought up to date when one of those commands runs. Useful
+    // for script replay and for many concurrent writers, who then only append
+    // to a dirty list instead of re-sifting the heaps on every change.
+    void beginBatch();
+    void endBatch();
+
+    // Commands write their results to `out` and their errors to `err`.
+    void CREATE(const string& filename, ostream& out = cout, ostream& err = cerr);
+    void READ(const string& filename, ostream& out = cout, ostream& err = cerr);
+    // INSERT appends straight from `content`; UPDATE takes ownership of it, so
+    // passing an rvalue hands the buffer to the new version without a copy.
+    void INSERT(const string& filename, string_view content, ostream& out = cout, ostream& err = cerr);
+    void UPDATE(const string& filename, string content, ostream& out = cout, ostream& err = cerr);
+    void SNAPSHOT(const string& filename, const string& message, ostream& out = cout, ostream& err = cerr);
+    void ROLLBACK(const string& filename, int versionID = -1, ostream& out = cout, ostream& err = cerr);
+    void HISTORY(const string& filename, ostream& out = cout, ostream& err = cerr);
+    void DIFF(const string& filename, int versionA, int versionB, ostream& out = cout, ostream& err = cerr);
+    void MERGE(const string& filename, int versionA, int versionB, ostream& out = cout, ostream& err = cerr);
+    void TAG(const string& filename, int versionID, ostream& out = cout, ostream& err = cerr);
+    // Prints the content of the version that was active at time t.
+    void AS_OF_READ(Timestamp t, const string& filename, ostream& out = cout, ostream& err = cerr);
+    // Lists the files changed between t1 and t2 inclusive.
+    void CHANGED_BETWEEN(Timestamp t1, Timestamp t2, ostream& out = cout, ostream& err = cerr);
+    void GC(int keep_last = -1, ostream& out = cout);
+    void RECENT_FILES(int num, ostream& out = cout);
+    void BIGGEST_TREES(int num, ostream& out = cout);
+    void BLOB_STATS(ostream& out = cout);
+    void CHECKPOINT(ostream& out = cout, ostream& err = cerr);
+    // Lists the files whose active version, or with all_history every version,
+    // contains all the words of `query` in its content or snapshot message.
+    void SEARCH(bool all_history, const string& query, ostream& out = cout, ostream& err = cerr);
+    // Lists, in name order, the files whose names start with `prefix`; at most
+    // `limit` of them unless it is -1.
+    void LS(const string& prefix, int limit, ostream& out = cout);
+    // Prints per-command latencies, stage timings, memory held and the shape of
+    // the file table; as one line of JSON when `json` is set. Only available in
+    // builds with TTFS_STATS.
+    void STATS(bool json, ostream& out = cout, ostream& err = cerr);
+#ifdef TTFS_STATS
+    // For stages timed outside FileSystem.
+    LatencyHistogram& stageLatency(StatStage stage);
+#endif
 };
 
 #endif 
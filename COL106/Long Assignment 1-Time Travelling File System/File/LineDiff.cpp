@@ -0,0 +1,270 @@
+#include "LineDiff.hpp"
+#include "../DataStructures/HashMap.hpp"
+
+using namespace std;
+
+vector<string_view> splitLines(string_view content) {
+    vector<string_view> lines;
+    if (content.empty()) {
+        return lines;
+    }
+    size_t start = 0;
+    while (true) {
+        size_t end = content.find('\n', start);
+        if (end == string_view::npos) {
+            lines.push_back(content.substr(start));
+            return lines;
+        }
+        lines.push_back(content.substr(start, end - start));
+        start = end + 1;
+    }
+}
+
+namespace {
+
+struct DiffTask {
+    int a0, a1, b0, b1;
+    bool keep_run; // emit a1 - a0 unchanged lines instead of diffing
+};
+
+// Finds a point on a shortest edit path of A[a0, a1) x B[b0, b1) by running the
+// forward and reverse Myers searches until they overlap. Both ranges must be
+// non-empty. Returns false if no split was found.
+bool bisect(const vector<int>& A, const vector<int>& B, int a0, int a1, int b0, int b1,
+            int& split_a, int& split_b) {
+    int n = a1 - a0;
+    int m = b1 - b0;
+    int max_d = (n + m + 1) / 2;
+    int offset = max_d;
+    int v_length = 2 * max_d + 2;
+    vector<int> v1(v_length, -1);
+    vector<int> v2(v_length, -1);
+    v1[offset + 1] = 0;
+    v2[offset + 1] = 0;
+    int delta = n - m;
+    bool front = (delta % 2) != 0;
+    int k1start = 0, k1end = 0, k2start = 0, k2end = 0;
+
+    for (int d = 0; d < max_d; ++d) {
+        for (int k1 = -d + k1start; k1 <= d - k1end; k1 += 2) {
+            int k1_offset = offset + k1;
+            int x1 = (k1 == -d || (k1 != d && v1[k1_offset - 1] < v1[k1_offset + 1]))
+                ? v1[k1_offset + 1] : v1[k1_offset - 1] + 1;
+            int y1 = x1 - k1;
+            while (x1 < n && y1 < m && A[a0 + x1] == B[b0 + y1]) {
+                x1++;
+                y1++;
+            }
+            v1[k1_offset] = x1;
+            if (x1 > n) {
+                k1end += 2;
+            } else if (y1 > m) {
+                k1start += 2;
+            } else if (front) {
+                int k2_offset = offset + delta - k1;
+                if (k2_offset >= 0 && k2_offset < v_length && v2[k2_offset] != -1 && x1 >= n - v2[k2_offset]) {
+                    split_a = a0 + x1;
+                    split_b = b0 + y1;
+                    return true;
+                }
+            }
+        }
+
+        for (int k2 = -d + k2start; k2 <= d - k2end; k2 += 2) {
+            int k2_offset = offset + k2;
+            int x2 = (k2 == -d || (k2 != d && v2[k2_offset - 1] < v2[k2_offset + 1]))
+                ? v2[k2_offset + 1] : v2[k2_offset - 1] + 1;
+            int y2 = x2 - k2;
+            while (x2 < n && y2 < m && A[a1 - x2 - 1] == B[b1 - y2 - 1]) {
+                x2++;
+                y2++;
+            }
+            v2[k2_offset] = x2;
+            if (x2 > n) {
+                k2end += 2;
+            } else if (y2 > m) {
+                k2start += 2;
+            } else if (!front) {
+                int k1_offset = offset + delta - k2;
+                if (k1_offset >= 0 && k1_offset < v_length && v1[k1_offset] != -1) {
+                    int x1 = v1[k1_offset];
+                    int y1 = offset + x1 - k1_offset;
+                    if (x1 >= n - x2) {
+                        split_a = a0 + x1;
+                        split_b = b0 + y1;
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+}
+
+vector<DiffOp> diffLines(const vector<string_view>& a, const vector<string_view>& b) {
+    HashMap<string_view, int> line_ids;
+    vector<int> A, B;
+    A.reserve(a.size());
+    B.reserve(b.size());
+    for (int pass = 0; pass < 2; ++pass) {
+        const vector<string_view>& lines = pass == 0 ? a : b;
+        vector<int>& ids = pass == 0 ? A : B;
+        for (string_view line : lines) {
+            int* id = line_ids.get(line);
+            if (id == nullptr) {
+                int next_id = line_ids.size();
+                line_ids.INSERT(line, next_id);
+                ids.push_back(next_id);
+            } else {
+                ids.push_back(*id);
+            }
+        }
+    }
+
+    vector<DiffOp> ops;
+    vector<DiffTask> tasks;
+    tasks.push_back({0, static_cast<int>(A.size()), 0, static_cast<int>(B.size()), false});
+    while (!tasks.empty()) {
+        DiffTask task = tasks.back();
+        tasks.pop_back();
+        int a0 = task.a0, a1 = task.a1, b0 = task.b0, b1 = task.b1;
+        if (task.keep_run) {
+            for (int i = 0; i < a1 - a0; ++i) {
+                ops.push_back({DIFF_KEEP, a0 + i, b0 + i});
+            }
+            continue;
+        }
+
+        while (a0 < a1 && b0 < b1 && A[a0] == B[b0]) {
+            ops.push_back({DIFF_KEEP, a0++, b0++});
+        }
+        int suffix = 0;
+        while (a1 > a0 && b1 > b0 && A[a1 - 1] == B[b1 - 1]) {
+            a1--;
+            b1--;
+            suffix++;
+        }
+        if (suffix > 0) {
+            tasks.push_back({a1, a1 + suffix, b1, b1 + suffix, true});
+        }
+
+        int split_a = 0, split_b = 0;
+        if (a0 == a1 || b0 == b1 || !bisect(A, B, a0, a1, b0, b1, split_a, split_b)) {
+            for (int i = a0; i < a1; ++i) {
+                ops.push_back({DIFF_DELETE, i, -1});
+            }
+            for (int j = b0; j < b1; ++j) {
+                ops.push_back({DIFF_ADD, -1, j});
+            }
+            continue;
+        }
+        tasks.push_back({split_a, a1, split_b, b1, false});
+        tasks.push_back({a0, split_a, b0, split_b, false});
+    }
+    return ops;
+}
+
+namespace {
+
+// Maps every base line to the line of `other` it is kept as, or -1.
+vector<int> matchBaseLines(const vector<string_view>& base, const vector<string_view>& other) {
+    vector<int> match(base.size(), -1);
+    for (const DiffOp& op : diffLines(base, other)) {
+        if (op.kind == DIFF_KEEP) {
+            match[op.a_line] = op.b_line;
+        }
+    }
+    return match;
+}
+
+bool sameLines(const vector<string_view>& x, int x0, int x1, const vector<string_view>& y, int y0, int y1) {
+    if (x1 - x0 != y1 - y0) {
+        return false;
+    }
+    for (int i = 0; i < x1 - x0; ++i) {
+        if (x[x0 + i] != y[y0 + i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void appendLines(vector<string_view>& out, const vector<string_view>& lines, int from, int to) {
+    for (int i = from; i < to; ++i) {
+        out.push_back(lines[i]);
+    }
+}
+
+}
+
+MergeResult threeWayMerge(string_view base, string_view ours, string_view theirs,
+                          const string& ours_label, const string& theirs_label) {
+    vector<string_view> o = splitLines(base);
+    vector<string_view> a = splitLines(ours);
+    vector<string_view> b = splitLines(theirs);
+    vector<int> match_a = matchBaseLines(o, a);
+    vector<int> match_b = matchBaseLines(o, b);
+
+    string open_marker = "<<<<<<< " + ours_label;
+    string close_marker = ">>>>>>> " + theirs_label;
+    vector<string_view> merged;
+    int conflicts = 0;
+    int n_o = o.size(), n_a = a.size(), n_b = b.size();
+    int io = 0, ia = 0, ib = 0;
+    while (true) {
+        if (io < n_o && match_a[io] == ia && match_b[io] == ib) {
+            merged.push_back(o[io]);
+            io++;
+            ia++;
+            ib++;
+            continue;
+        }
+
+        // The unstable region runs up to the next base line both sides kept.
+        int next = io;
+        while (next < n_o && (match_a[next] == -1 || match_b[next] == -1)) {
+            next++;
+        }
+        int end_a = next < n_o ? match_a[next] : n_a;
+        int end_b = next < n_o ? match_b[next] : n_b;
+
+        bool a_unchanged = sameLines(o, io, next, a, ia, end_a);
+        bool b_unchanged = sameLines(o, io, next, b, ib, end_b);
+        if (a_unchanged) {
+            appendLines(merged, b, ib, end_b);
+        } else if (b_unchanged || sameLines(a, ia, end_a, b, ib, end_b)) {
+            appendLines(merged, a, ia, end_a);
+        } else {
+            conflicts++;
+            merged.push_back(open_marker);
+            appendLines(merged, a, ia, end_a);
+            merged.push_back("=======");
+            appendLines(merged, b, ib, end_b);
+            merged.push_back(close_marker);
+        }
+
+        if (next >= n_o) {
+            break;
+        }
+        io = next;
+        ia = end_a;
+        ib = end_b;
+    }
+
+    MergeResult result;
+    result.conflicts = conflicts;
+    size_t total = 0;
+    for (string_view line : merged) {
+        total += line.size() + 1;
+    }
+    result.content.reserve(total);
+    for (size_t i = 0; i < merged.size(); ++i) {
+        if (i > 0) {
+            result.content += '\n';
+        }
+        result.content.append(merged[i].data(), merged[i].size());
+    }
+    return result;
+}
@@ -0,0 +1,43 @@
+#ifndef LINEDIFF_HPP
+#define LINEDIFF_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+enum DiffKind { DIFF_KEEP, DIFF_DELETE, DIFF_ADD };
+
+// One line of an edit script. a_line / b_line index the old and new line lists;
+// the side a line does not exist on is -1.
+struct DiffOp {
+    DiffKind kind;
+    int a_line;
+    int b_line;
+};
+
+// Splits content on '\n'. Empty content has no lines.
+vector<string_view> splitLines(string_view content);
+
+// Shortest edit script turning `a` into `b`, computed with Myers' O((N+M)D)
+// algorithm in its linear-space divide-and-conquer form. Lines are interned to
+// integers first so the inner loop compares ints, and common prefixes and
+// suffixes are peeled off every subproblem before bisecting it.
+vector<DiffOp> diffLines(const vector<string_view>& a, const vector<string_view>& b);
+
+struct MergeResult {
+    string content;
+    int conflicts;
+};
+
+// diff3-style three-way merge of `ours` and `theirs` against their common `base`.
+// Both sides are diffed against the base once; lines kept by both sides anchor
+// stable regions, and each region between anchors is taken from whichever side
+// changed it. Regions both sides changed differently are emitted between
+// conflict markers labelled with ours_label / theirs_label. Runs in the time of
+// the two diffs plus a linear walk.
+MergeResult threeWayMerge(string_view base, string_view ours, string_view theirs,
+                          const string& ours_label, const string& theirs_label);
+
+#endif
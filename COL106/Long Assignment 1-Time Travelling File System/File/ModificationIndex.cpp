@@ -0,0 +1,88 @@
+#include "ModificationIndex.hpp"
+#include <algorithm>
+
+using namespace std;
+
+static Modification fromRecord(const ImageEventRecord& record) {
+    return Modification{record.time, record.file_id, record.version_id, static_cast<LogOp>(record.op)};
+}
+
+ModificationIndex::ModificationIndex() : image(nullptr) {}
+
+void ModificationIndex::add(const Modification& change) {
+    lock_guard<mutex> guard(lock);
+    recent.push_back(change);
+    size_t i = recent.size() - 1;
+    while (i > 0 && recent[i - 1].time > change.time) {
+        recent[i] = recent[i - 1];
+        i--;
+    }
+    recent[i] = change;
+}
+
+// First image event at or after t.
+uint64_t ModificationIndex::imageLowerBound(Timestamp t) const {
+    uint64_t lo = 0, hi = image ? image->eventCount() : 0;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (image->event(mid).time < t) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void ModificationIndex::range(Timestamp t1, Timestamp t2, vector<Modification>& out) const {
+    lock_guard<mutex> guard(lock);
+    size_t first = out.size();
+    if (image) {
+        for (uint64_t i = imageLowerBound(t1); i < image->eventCount(); ++i) {
+            ImageEventRecord record = image->event(i);
+            if (record.time > t2) {
+                break;
+            }
+            out.push_back(fromRecord(record));
+        }
+    }
+    size_t lo = 0, hi = recent.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (recent[mid].time < t1) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    size_t middle = out.size();
+    for (size_t i = lo; i < recent.size() && recent[i].time <= t2; ++i) {
+        out.push_back(recent[i]);
+    }
+    inplace_merge(out.begin() + first, out.begin() + middle, out.end(),
+                  [](const Modification& a, const Modification& b) { return a.time < b.time; });
+}
+
+// Image events and recent ones are each sorted, and a replayed log can
+// interleave them, so the two runs are merged.
+void ModificationIndex::writeImage(SnapshotImageWriter& out) const {
+    lock_guard<mutex> guard(lock);
+    uint64_t image_count = image ? image->eventCount() : 0;
+    uint64_t i = 0;
+    size_t j = 0;
+    while (i < image_count || j < recent.size()) {
+        Modification change;
+        if (j == recent.size() || (i < image_count && image->event(i).time <= recent[j].time)) {
+            change = fromRecord(image->event(i++));
+        } else {
+            change = recent[j++];
+        }
+        out.addEvent(change.time, change.file_id, change.version_id, change.op);
+    }
+}
+
+void ModificationIndex::attachImage(const SnapshotImage* new_image) {
+    lock_guard<mutex> guard(lock);
+    image = new_image;
+    recent.clear();
+}
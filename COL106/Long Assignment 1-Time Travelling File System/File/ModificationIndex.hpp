@@ -0,0 +1,48 @@
+#ifndef MODIFICATIONINDEX_HPP
+#define MODIFICATIONINDEX_HPP
+
+#include "../DataStructures/Timestamp.hpp"
+#include "../Storage/SnapshotImage.hpp"
+#include "../Storage/WriteAheadLog.hpp"
+#include <vector>
+#include <mutex>
+
+using namespace std;
+
+struct Modification {
+    Timestamp time;
+    int file_id;
+    int version_id; // active version after the change
+    LogOp op;
+};
+
+// Every change to any file, ordered by time, so CHANGED_BETWEEN finds its
+// range by binary search instead of walking every version tree. Changes
+// covered by the latest checkpoint are read in place from its image; later
+// ones are kept in `recent`.
+//
+// Threads can take their timestamps in one order and record them in another,
+// so add() slides each change back past the few later ones already recorded
+// rather than assuming it belongs at the end.
+class ModificationIndex {
+private:
+    mutable mutex lock;
+    const SnapshotImage* image;
+    vector<Modification> recent;
+
+    uint64_t imageLowerBound(Timestamp t) const;
+
+public:
+    ModificationIndex();
+
+    void add(const Modification& change);
+    // Appends the changes made between t1 and t2 inclusive to `out`, in time order.
+    void range(Timestamp t1, Timestamp t2, vector<Modification>& out) const;
+
+    // Writes every change to the image being built, in time order.
+    void writeImage(SnapshotImageWriter& out) const;
+    // Switches to an image holding every change recorded so far.
+    void attachImage(const SnapshotImage* new_image);
+};
+
+#endif
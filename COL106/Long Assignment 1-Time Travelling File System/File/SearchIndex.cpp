@@ -0,0 +1,329 @@
+#include "SearchIndex.hpp"
+#include <algorithm>
+
+using namespace std;
+
+static bool isWordByte(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+}
+
+// Appends the word starting at text[i] to `word`, lowercased and cut to
+// max_word bytes, and returns where it ends.
+static size_t readWord(string_view text, size_t i, size_t max_word, string& word) {
+    for (; i < text.size() && isWordByte(text[i]); ++i) {
+        if (word.size() < max_word) {
+            char c = text[i];
+            word += (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+        }
+    }
+    return i;
+}
+
+vector<string> SearchIndex::words(string_view text) {
+    vector<string> result;
+    size_t i = 0;
+    while (i < text.size()) {
+        while (i < text.size() && !isWordByte(text[i])) {
+            i++;
+        }
+        if (i == text.size()) {
+            break;
+        }
+        string word;
+        i = readWord(text, i, MAX_WORD, word);
+        result.push_back(std::move(word));
+    }
+    return result;
+}
+
+SearchIndex::Tokens SearchIndex::tokenize(string_view text) {
+    Tokens tokens;
+    size_t i = readWord(text, 0, MAX_WORD, tokens.head);
+    tokens.separated = i < text.size();
+    while (i < text.size()) {
+        while (i < text.size() && !isWordByte(text[i])) {
+            i++;
+        }
+        if (i == text.size()) {
+            break;
+        }
+        string word;
+        i = readWord(text, i, MAX_WORD, word);
+        if (i == text.size()) {
+            tokens.tail = std::move(word);
+        } else {
+            tokens.words.push_back(std::move(word));
+        }
+    }
+    return tokens;
+}
+
+SearchIndex::FileEntry& SearchIndex::fileEntry(int file_id) {
+    if (file_id >= static_cast<int>(files.size())) {
+        files.resize(file_id + 1, FileEntry{vector<int>(), 0});
+    }
+    return files[file_id];
+}
+
+// The new document becomes the version's current one; any earlier one is retired.
+int SearchIndex::newDocument(int file_id, int version_id, int base) {
+    int doc = docs.size();
+    docs.push_back(Document{file_id, version_id, base, -1, -1, true, string(), -1});
+    if (base >= 0) {
+        docs[doc].next_sibling = docs[base].first_child;
+        docs[base].first_child = doc;
+    }
+    FileEntry& entry = fileEntry(file_id);
+    if (version_id >= static_cast<int>(entry.version_doc.size())) {
+        entry.version_doc.resize(version_id + 1, -1);
+    }
+    int& current = entry.version_doc[version_id];
+    if (current >= 0) {
+        docs[current].live = false;
+        setTail(current, string());
+    }
+    current = doc;
+    return doc;
+}
+
+uint32_t SearchIndex::newSegment(int doc, bool message) {
+    segment_doc.push_back(static_cast<uint32_t>(doc) | (message ? MESSAGE_SEGMENT : 0));
+    return segment_doc.size() - 1;
+}
+
+void SearchIndex::post(const string& word, uint32_t segment) {
+    PostingList* list = postings.get(word);
+    if (list == nullptr) {
+        postings.INSERT(word, PostingList{string(), 0, 0});
+        list = postings.get(word);
+    }
+    if (list->count > 0 && list->last_segment == segment) {
+        return;
+    }
+    uint32_t gap = segment - list->last_segment;
+    while (gap >= 0x80) {
+        list->gaps += static_cast<char>((gap & 0x7F) | 0x80);
+        gap >>= 7;
+    }
+    list->gaps += static_cast<char>(gap);
+    list->last_segment = segment;
+    list->count++;
+}
+
+// Moves the document between tail_docs lists; an empty tail is not listed.
+void SearchIndex::setTail(int doc, string tail) {
+    Document& d = docs[doc];
+    if (d.tail == tail) {
+        return;
+    }
+    if (!d.tail.empty()) {
+        vector<int>& list = *tail_docs.get(d.tail);
+        list[d.tail_pos] = list.back();
+        docs[list.back()].tail_pos = d.tail_pos;
+        list.pop_back();
+    }
+    if (!tail.empty()) {
+        vector<int>* list = tail_docs.get(tail);
+        if (list == nullptr) {
+            tail_docs.INSERT(tail, vector<int>());
+            list = tail_docs.get(tail);
+        }
+        d.tail_pos = list->size();
+        list->push_back(doc);
+    }
+    d.tail = std::move(tail);
+}
+
+// Appends a text to the document, whose content so far ends with the word `tail`.
+void SearchIndex::addText(int doc, string tail, const Tokens& tokens) {
+    uint32_t segment = newSegment(doc, false);
+    for (size_t i = 0; i < tokens.head.size() && tail.size() < MAX_WORD; ++i) {
+        tail += tokens.head[i];
+    }
+    if (!tokens.separated) {
+        setTail(doc, std::move(tail));
+        return;
+    }
+    if (!tail.empty()) {
+        post(tail, segment);
+    }
+    for (const string& word : tokens.words) {
+        post(word, segment);
+    }
+    setTail(doc, tokens.tail);
+}
+
+void SearchIndex::addFile(int file_id) {
+    lock_guard<mutex> guard(lock);
+    fileEntry(file_id).active_version = 0;
+}
+
+void SearchIndex::insert(int file_id, int version_id, int parent_id, string_view text) {
+    Tokens tokens = tokenize(text);
+    lock_guard<mutex> guard(lock);
+    FileEntry& entry = fileEntry(file_id);
+    int doc;
+    string tail;
+    if (parent_id >= 0) {
+        int base = parent_id < static_cast<int>(entry.version_doc.size()) ? entry.version_doc[parent_id] : -1;
+        doc = newDocument(file_id, version_id, base);
+        if (base >= 0) {
+            tail = docs[base].tail;
+        }
+    } else if (version_id < static_cast<int>(entry.version_doc.size()) && entry.version_doc[version_id] >= 0) {
+        doc = entry.version_doc[version_id];
+        tail = docs[doc].tail;
+    } else {
+        doc = newDocument(file_id, version_id, -1);
+    }
+    fileEntry(file_id).active_version = version_id;
+    addText(doc, std::move(tail), tokens);
+}
+
+void SearchIndex::update(int file_id, int version_id, string_view text) {
+    Tokens tokens = tokenize(text);
+    lock_guard<mutex> guard(lock);
+    int doc = newDocument(file_id, version_id, -1);
+    fileEntry(file_id).active_version = version_id;
+    addText(doc, string(), tokens);
+}
+
+void SearchIndex::snapshot(int file_id, int version_id, string_view message) {
+    vector<string> message_words = words(message);
+    lock_guard<mutex> guard(lock);
+    FileEntry& entry = fileEntry(file_id);
+    int doc = version_id < static_cast<int>(entry.version_doc.size()) ? entry.version_doc[version_id] : -1;
+    if (doc < 0) {
+        doc = newDocument(file_id, version_id, -1);
+    }
+    uint32_t segment = newSegment(doc, true);
+    for (const string& word : message_words) {
+        post(word, segment);
+    }
+}
+
+void SearchIndex::activate(int file_id, int version_id) {
+    lock_guard<mutex> guard(lock);
+    fileEntry(file_id).active_version = version_id;
+}
+
+vector<int> SearchIndex::liveVersions(int file_id) const {
+    lock_guard<mutex> guard(lock);
+    vector<int> result;
+    if (file_id < static_cast<int>(files.size())) {
+        const vector<int>& version_doc = files[file_id].version_doc;
+        for (size_t v = 0; v < version_doc.size(); ++v) {
+            if (version_doc[v] >= 0) {
+                result.push_back(v);
+            }
+        }
+    }
+    return result;
+}
+
+// The retired document stays in the inheritance tree, so versions that
+// inherited from it keep its words.
+void SearchIndex::removeVersion(int file_id, int version_id) {
+    lock_guard<mutex> guard(lock);
+    FileEntry& entry = fileEntry(file_id);
+    if (version_id < static_cast<int>(entry.version_doc.size()) && entry.version_doc[version_id] >= 0) {
+        docs[entry.version_doc[version_id]].live = false;
+        setTail(entry.version_doc[version_id], string());
+        entry.version_doc[version_id] = -1;
+    }
+}
+
+// Sorted documents containing `word`: those ending with it, those with a
+// segment holding it, and every document inheriting content from the latter.
+// Works in time proportional to the matches, not to the whole index.
+void SearchIndex::matchWord(const string& word, vector<int>& matches) const {
+    matches.clear();
+    const vector<int>* ending = tail_docs.get(word);
+    if (ending != nullptr) {
+        matches.assign(ending->begin(), ending->end());
+    }
+    const PostingList* list = postings.get(word);
+    vector<int> roots; // documents with a content segment holding the word
+    uint32_t segment = 0;
+    size_t pos = 0;
+    for (uint32_t n = 0; list != nullptr && n < list->count; ++n) {
+        uint32_t gap = 0;
+        int shift = 0;
+        unsigned char byte;
+        do {
+            byte = list->gaps[pos++];
+            gap |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        segment += gap;
+        int doc = segment_doc[segment] & ~MESSAGE_SEGMENT;
+        if (segment_doc[segment] & MESSAGE_SEGMENT) {
+            matches.push_back(doc);
+        } else {
+            roots.push_back(doc);
+        }
+    }
+    sort(roots.begin(), roots.end());
+    roots.erase(unique(roots.begin(), roots.end()), roots.end());
+
+    // A document is numbered after the one it inherits from, so in id order a
+    // root is reached through any earlier root above it before its own turn;
+    // such roots are marked covered and their subtree is not walked again.
+    vector<char> covered(roots.size(), 0);
+    vector<int> pending;
+    for (size_t r = 0; r < roots.size(); ++r) {
+        if (covered[r]) {
+            continue;
+        }
+        pending.push_back(roots[r]);
+        while (!pending.empty()) {
+            int doc = pending.back();
+            pending.pop_back();
+            matches.push_back(doc);
+            for (int child = docs[doc].first_child; child != -1; child = docs[child].next_sibling) {
+                auto it = lower_bound(roots.begin() + r + 1, roots.end(), child);
+                if (it != roots.end() && *it == child) {
+                    covered[it - roots.begin()] = 1;
+                }
+                pending.push_back(child);
+            }
+        }
+    }
+    sort(matches.begin(), matches.end());
+    matches.erase(unique(matches.begin(), matches.end()), matches.end());
+}
+
+void SearchIndex::search(const vector<string>& terms, bool all_history, vector<SearchHit>& out) const {
+    lock_guard<mutex> guard(lock);
+    if (terms.empty()) {
+        return;
+    }
+    // Start from the rarest word so the intersections stay small.
+    vector<string> order(terms);
+    sort(order.begin(), order.end(), [this](const string& a, const string& b) {
+        const PostingList* la = postings.get(a);
+        const PostingList* lb = postings.get(b);
+        return (la ? la->count : 0) < (lb ? lb->count : 0);
+    });
+    vector<int> result;
+    vector<int> matches;
+    vector<int> common;
+    matchWord(order[0], result);
+    for (size_t i = 1; i < order.size() && !result.empty(); ++i) {
+        matchWord(order[i], matches);
+        common.clear();
+        set_intersection(result.begin(), result.end(), matches.begin(), matches.end(), back_inserter(common));
+        result.swap(common);
+    }
+
+    size_t first = out.size();
+    for (int doc : result) {
+        const Document& d = docs[doc];
+        if (d.live && (all_history || files[d.file_id].active_version == d.version_id)) {
+            out.push_back(SearchHit{d.file_id, d.version_id});
+        }
+    }
+    sort(out.begin() + first, out.end(), [](const SearchHit& a, const SearchHit& b) {
+        return a.file_id != b.file_id ? a.file_id < b.file_id : a.version_id < b.version_id;
+    });
+}
@@ -0,0 +1,110 @@
+#ifndef SEARCHINDEX_HPP
+#define SEARCHINDEX_HPP
+
+#include "../DataStructures/HashMap.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <mutex>
+
+using namespace std;
+
+struct SearchHit {
+    int file_id;
+    int version_id;
+};
+
+// Inverted index from words to the versions that contain them, kept up to date
+// as files change rather than rebuilt per query.
+//
+// Words are runs of letters, digits, '_' and non-ASCII bytes, lowercased and cut
+// to MAX_WORD bytes. Snapshot messages are indexed on their own.
+//
+// Indexing mirrors how versions store content. Every write becomes a segment,
+// numbered in order, and a word's posting list holds the segments it occurs in
+// as varint gaps. Segments belong to a document: one per version, or a fresh
+// one when UPDATE replaces a version's content. A document made by INSERT on a
+// snapshot inherits the words of its parent's document, so appending to a deep
+// chain indexes only the appended text, and queries carry matches down to the
+// inheriting documents instead. Message words are not inherited.
+//
+// The last word of a document's content can still grow: after INSERTs of "log"
+// and "file" the content holds "logfile", not "log". So that word is kept as
+// the document's tail, outside the posting lists, and is only posted once
+// later text puts a separator after it. Tails are looked up on their own and
+// are not inherited; a document made by INSERT starts from its parent's tail.
+class SearchIndex {
+private:
+    static const size_t MAX_WORD = 64;
+    static const uint32_t MESSAGE_SEGMENT = 1u << 31; // flag on segment_doc entries
+
+    struct PostingList {
+        string gaps; // varint-encoded differences between successive segment ids
+        uint32_t last_segment;
+        uint32_t count;
+    };
+
+    struct Document {
+        int file_id;
+        int version_id;
+        int base; // document whose words this one inherits, or -1
+        int first_child;
+        int next_sibling;
+        bool live; // false once replaced by UPDATE or removed by GC
+        string tail; // word the content ends with, not in any posting list
+        int tail_pos; // index in tail_docs[tail]
+    };
+
+    // The words of one INSERT or UPDATE text, split so its ends can be joined
+    // to the content around it.
+    struct Tokens {
+        string head;          // word bytes the text starts with
+        vector<string> words; // whole words between the first and last separator
+        string tail;          // word bytes after the last separator
+        bool separated;       // whether the text has a non-word byte at all
+    };
+
+    struct FileEntry {
+        vector<int> version_doc; // version id -> current document, or -1
+        int active_version;
+    };
+
+    mutable mutex lock;
+    HashMap<string, PostingList> postings;
+    vector<uint32_t> segment_doc; // segment id -> document, with MESSAGE_SEGMENT for messages
+    vector<Document> docs;
+    vector<FileEntry> files; // file id -> entry
+    HashMap<string, vector<int>> tail_docs; // tail -> documents ending with it
+
+    static Tokens tokenize(string_view text);
+    FileEntry& fileEntry(int file_id);
+    int newDocument(int file_id, int version_id, int base);
+    uint32_t newSegment(int doc, bool message);
+    void post(const string& word, uint32_t segment);
+    void setTail(int doc, string tail);
+    void addText(int doc, string tail, const Tokens& tokens);
+    void matchWord(const string& word, vector<int>& matches) const;
+
+public:
+    // Splits `text` into the words the index stores; duplicates are kept.
+    static vector<string> words(string_view text);
+
+    void addFile(int file_id);
+    // INSERT: appends `text` to a version. parent_id is the version it was just
+    // branched from, or -1 if it already existed.
+    void insert(int file_id, int version_id, int parent_id, string_view text);
+    // UPDATE and MERGE: the version's content is now exactly `text`.
+    void update(int file_id, int version_id, string_view text);
+    void snapshot(int file_id, int version_id, string_view message);
+    void activate(int file_id, int version_id);
+    // Versions of the file still indexed as live.
+    vector<int> liveVersions(int file_id) const;
+    void removeVersion(int file_id, int version_id);
+
+    // Versions containing every word of `terms`, ordered by file and version.
+    // With all_history unset only each file's active version is considered.
+    void search(const vector<string>& terms, bool all_history, vector<SearchHit>& out) const;
+};
+
+#endif
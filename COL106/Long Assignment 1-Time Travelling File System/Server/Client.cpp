@@ -0,0 +1,103 @@
+#include "Protocol.hpp"
+#include "Socket.hpp"
+#include <iostream>
+#include <string>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+using namespace std;
+
+// Command-line client for `filesystem --serve`. Reads commands from standard
+// input exactly like the interactive shell and prints each response's output
+// and errors to standard output and standard error. Input is forwarded as soon
+// as it is read, without waiting for earlier responses, so a piped script is
+// sent pipelined. Usage: ttfs_client <address>
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        cerr << "Usage: " << argv[0] << " <socket path | host:port>" << endl;
+        return 1;
+    }
+    string error;
+    int fd = connectTo(argv[1], error);
+    if (fd < 0) {
+        cerr << "Error: " << error << "." << endl;
+        return 1;
+    }
+
+    ResponseParser parser;
+    Response response;
+    string outgoing;
+    size_t outgoing_pos = 0;
+    long long sent_lines = 0;
+    long long received = 0;
+    bool input_done = false;
+    bool last_line_open = false;
+    char chunk[1 << 16];
+    // Standard input is only read once the previous chunk has been handed to
+    // the socket, and the socket is drained all the while, so a server that
+    // stops reading until its responses are consumed cannot deadlock us.
+    while (!input_done || outgoing_pos < outgoing.size() || received < sent_lines) {
+        bool sending = outgoing_pos < outgoing.size();
+        pollfd fds[2];
+        int nfds = 0;
+        fds[nfds++] = {fd, static_cast<short>(POLLIN | (sending ? POLLOUT : 0)), 0};
+        if (!input_done && !sending) {
+            fds[nfds++] = {STDIN_FILENO, POLLIN, 0};
+        }
+        if (poll(fds, nfds, -1) < 0) {
+            continue;
+        }
+        if (nfds > 1 && (fds[1].revents & (POLLIN | POLLHUP))) {
+            ssize_t n = read(STDIN_FILENO, chunk, sizeof(chunk));
+            outgoing.clear();
+            outgoing_pos = 0;
+            if (n > 0) {
+                outgoing.assign(chunk, n);
+                for (char c : outgoing) {
+                    sent_lines += (c == '\n');
+                }
+                last_line_open = outgoing.back() != '\n';
+            } else {
+                input_done = true;
+                if (last_line_open) {
+                    outgoing = "\n";
+                    sent_lines++;
+                } else {
+                    shutdown(fd, SHUT_WR);
+                }
+            }
+        }
+        if (sending && (fds[0].revents & POLLOUT)) {
+            ssize_t n = send(fd, outgoing.data() + outgoing_pos, outgoing.size() - outgoing_pos, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                cerr << "Error: Connection to server lost." << endl;
+                return 1;
+            }
+            outgoing_pos += n > 0 ? n : 0;
+            if (input_done && outgoing_pos == outgoing.size()) {
+                shutdown(fd, SHUT_WR);
+            }
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if (n <= 0) {
+                if (received < sent_lines) {
+                    cerr << "Error: Connection to server lost." << endl;
+                    return 1;
+                }
+                break;
+            }
+            parser.feed(chunk, n);
+            while (parser.next(response)) {
+                received++;
+                cout << response.out << flush;
+                cerr << response.err << flush;
+            }
+        }
+    }
+    close(fd);
+    return 0;
+}
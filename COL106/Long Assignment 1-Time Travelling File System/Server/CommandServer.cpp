@@ -0,0 +1,343 @@
+#include "CommandServer.hpp"
+#include "Protocol.hpp"
+#include "Socket.hpp"
+#include "../CLI/CommandRunner.hpp"
+#include <iostream>
+#include <sstream>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+
+using namespace std;
+
+// A client that keeps sending without reading its responses is not read from
+// again until its backlog drains below these sizes. A single request line
+// longer than MAX_PENDING_INPUT can never be completed, so it gets an error
+// response and the connection is closed.
+static const size_t MAX_PENDING_INPUT = 16 << 20;
+static const size_t MAX_PENDING_OUTPUT = 16 << 20;
+static const size_t READ_CHUNK = 64 << 10;
+
+CommandServer::CommandServer(FileSystem& file_system, int worker_threads)
+    : CommandServer([&file_system](string_view line, ostream& out, ostream& err) {
+          runCommand(file_system, line, out, err);
+      }, worker_threads) {}
+
+CommandServer::CommandServer(Handler request_handler, int worker_threads)
+    : handler(std::move(request_handler)), listen_fd(-1), epoll_fd(-1), wake_fd(-1), signal_fd(-1),
+      num_workers(worker_threads < 1 ? 1 : worker_threads), stopping(false) {}
+
+CommandServer::~CommandServer() {
+    for (Connection* connection : connections) {
+        if (connection != nullptr) {
+            close(connection->fd);
+            delete connection;
+        }
+    }
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        removeSocketFile(address);
+    }
+    for (int fd : {epoll_fd, wake_fd, signal_fd}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+static sigset_t stopSignals() {
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    return stop_signals;
+}
+
+void CommandServer::blockStopSignals() {
+    sigset_t stop_signals = stopSignals();
+    pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+}
+
+bool CommandServer::listen(const string& listen_address) {
+    string error;
+    listen_fd = listenOn(listen_address, error);
+    if (listen_fd < 0) {
+        cerr << "Error: " << error << "." << endl;
+        return false;
+    }
+    address = listen_address;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    // SIGINT/SIGTERM are taken through a signalfd by the loop, which only
+    // works while no thread of the process leaves them unblocked; see
+    // blockStopSignals().
+    sigset_t stop_signals = stopSignals();
+    blockStopSignals();
+    signal_fd = signalfd(-1, &stop_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int fd : {listen_fd, wake_fd, signal_fd}) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+    return true;
+}
+
+void CommandServer::run() {
+    for (int i = 0; i < num_workers; ++i) {
+        workers.emplace_back(&CommandServer::workerLoop, this);
+    }
+    cout << "Serving on " << address << " with " << num_workers << " worker(s)." << endl;
+
+    epoll_event events[64];
+    bool running = true;
+    while (running) {
+        int ready = epoll_wait(epoll_fd, events, 64, -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            cerr << "Error: epoll_wait failed." << endl;
+            break;
+        }
+        for (int i = 0; i < ready; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == listen_fd) {
+                acceptClients();
+            } else if (fd == wake_fd) {
+                uint64_t count;
+                while (read(wake_fd, &count, sizeof(count)) > 0) {
+                }
+                finishJobs();
+            } else if (fd == signal_fd) {
+                running = false;
+            } else if (fd < static_cast<int>(connections.size()) && connections[fd] != nullptr) {
+                Connection* connection = connections[fd];
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    readFrom(connection);
+                }
+                if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                    connection->eof = true;
+                    connection->broken = true;
+                }
+                if ((events[i].events & EPOLLOUT) && connections[fd] == connection) {
+                    writeTo(connection);
+                }
+                if (connections[fd] == connection && !closeIfFinished(connection)) {
+                    updateInterest(connection);
+                }
+            }
+        }
+    }
+
+    {
+        lock_guard<mutex> guard(queue_lock);
+        stopping = true;
+    }
+    queue_ready.notify_all();
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    lock_guard<mutex> guard(done_lock);
+    for (Job* job : done) {
+        delete job;
+    }
+    done.clear();
+    cout << "Server stopped." << endl;
+}
+
+void CommandServer::workerLoop() {
+    ostringstream out, err;
+    while (true) {
+        Job* job;
+        {
+            unique_lock<mutex> guard(queue_lock);
+            queue_ready.wait(guard, [this] { return stopping || !queued.empty(); });
+            if (queued.empty()) {
+                return;
+            }
+            job = queued.front();
+            queued.pop_front();
+        }
+        string_view requests = job->requests;
+        while (!requests.empty()) {
+            size_t eol = requests.find('\n');
+            string_view line = requests.substr(0, eol);
+            requests.remove_prefix(eol + 1);
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            out.str("");
+            err.str("");
+            handler(line, out, err);
+            appendResponse(job->responses, out.str(), err.str());
+        }
+        {
+            lock_guard<mutex> guard(done_lock);
+            done.push_back(job);
+        }
+        uint64_t one = 1;
+        ssize_t ignored = write(wake_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+void CommandServer::acceptClients() {
+    while (true) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        if (fd >= static_cast<int>(connections.size())) {
+            connections.resize(fd + 1, nullptr);
+        }
+        connections[fd] = new Connection{fd, "", "", 0, EPOLLIN, false, false, false};
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+void CommandServer::readFrom(Connection* connection) {
+    char chunk[READ_CHUNK];
+    while (connection->in.size() < MAX_PENDING_INPUT) {
+        ssize_t n = read(connection->fd, chunk, sizeof(chunk));
+        if (n > 0) {
+            connection->in.append(chunk, n);
+            continue;
+        }
+        if (n == 0) {
+            connection->eof = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            connection->eof = true;
+            connection->broken = true;
+        }
+        break;
+    }
+    dispatch(connection);
+}
+
+void CommandServer::writeTo(Connection* connection) {
+    while (connection->out_pos < connection->out.size()) {
+        ssize_t n = send(connection->fd, connection->out.data() + connection->out_pos,
+                         connection->out.size() - connection->out_pos, MSG_NOSIGNAL);
+        if (n > 0) {
+            connection->out_pos += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                connection->broken = true;
+                connection->eof = true;
+            }
+            break;
+        }
+    }
+    if (connection->out_pos == connection->out.size()) {
+        connection->out.clear();
+        connection->out_pos = 0;
+        dispatch(connection);
+    }
+}
+
+// Hands every complete request line to the pool as one job. A last line
+// without a newline still runs once the client has finished sending.
+void CommandServer::dispatch(Connection* connection) {
+    if (connection->busy || connection->broken ||
+        connection->out.size() - connection->out_pos >= MAX_PENDING_OUTPUT) {
+        return;
+    }
+    size_t end = connection->in.rfind('\n');
+    if (end == string::npos && connection->in.size() >= MAX_PENDING_INPUT) {
+        appendResponse(connection->out, "", "Error: Request line longer than " + to_string(MAX_PENDING_INPUT)
+                       + " bytes; closing the connection.\n");
+        connection->in.clear();
+        connection->eof = true;
+        return;
+    }
+    if (end == string::npos) {
+        if (!connection->eof || connection->in.empty()) {
+            return;
+        }
+        connection->in += '\n';
+        end = connection->in.size() - 1;
+    }
+    Job* job = new Job{connection, connection->in.substr(0, end + 1), ""};
+    connection->in.erase(0, end + 1);
+    connection->busy = true;
+    {
+        lock_guard<mutex> guard(queue_lock);
+        queued.push_back(job);
+    }
+    queue_ready.notify_one();
+}
+
+void CommandServer::finishJobs() {
+    vector<Job*> finished;
+    {
+        lock_guard<mutex> guard(done_lock);
+        finished.swap(done);
+    }
+    for (Job* job : finished) {
+        Connection* connection = job->connection;
+        connection->busy = false;
+        if (!connection->broken) {
+            connection->out += job->responses;
+        }
+        delete job;
+        writeTo(connection);
+        dispatch(connection);
+        if (!closeIfFinished(connection)) {
+            updateInterest(connection);
+        }
+    }
+}
+
+void CommandServer::updateInterest(Connection* connection) {
+    if (connection->broken) {
+        // Only waiting for its worker now; a failed socket would otherwise
+        // keep waking the loop until then.
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection->fd, nullptr);
+        return;
+    }
+    uint32_t interest = 0;
+    if (!connection->eof && connection->in.size() < MAX_PENDING_INPUT) {
+        interest |= EPOLLIN;
+    }
+    if (connection->out_pos < connection->out.size()) {
+        interest |= EPOLLOUT;
+    }
+    if (interest != connection->interest) {
+        epoll_event event{};
+        event.events = interest;
+        event.data.fd = connection->fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+        connection->interest = interest;
+    }
+}
+
+// A connection is closed once its client has stopped sending and every
+// response has been written, or as soon as its socket fails. Never while a
+// worker still holds its job.
+bool CommandServer::closeIfFinished(Connection* connection) {
+    if (connection->busy || !connection->eof) {
+        return false;
+    }
+    if (!connection->broken && (!connection->in.empty() || connection->out_pos < connection->out.size())) {
+        return false;
+    }
+    connections[connection->fd] = nullptr;
+    close(connection->fd);
+    delete connection;
+    return true;
+}
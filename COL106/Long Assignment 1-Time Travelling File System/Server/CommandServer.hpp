@@ -0,0 +1,97 @@
+#ifndef COMMANDSERVER_HPP
+#define COMMANDSERVER_HPP
+
+#include "../File/FileSystem.hpp"
+#include <string>
+#include <string_view>
+#include <functional>
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+// Long-running front end that serves the shell's commands over a socket
+// (see Protocol.hpp for the wire format).
+//
+// One thread runs an epoll loop that owns every connection: it accepts,
+// reads, writes and closes. Whenever a connection has complete request lines
+// and no job in flight, all of them are handed to the worker pool as one job,
+// and a worker runs them in order (against the FileSystem unless another
+// handler is given) and queues the responses back to the loop through an
+// eventfd. A connection has at most one job at a time, so its commands run in
+// the order they were sent, while commands from different connections run in
+// parallel.
+class CommandServer {
+public:
+    // Runs one request line, writing its output to the first stream and its
+    // errors to the second.
+    typedef function<void(string_view, ostream&, ostream&)> Handler;
+
+private:
+    struct Connection {
+        int fd;
+        string in;
+        string out;
+        size_t out_pos;
+        uint32_t interest;
+        bool busy;    // a worker is running this connection's job
+        bool eof;     // the client will send nothing more
+        bool broken;  // the socket failed; drop output and close
+    };
+
+    struct Job {
+        Connection* connection;
+        string requests;
+        string responses;
+    };
+
+    Handler handler;
+    string address;
+    int listen_fd;
+    int epoll_fd;
+    int wake_fd;
+    int signal_fd;
+    int num_workers;
+    vector<Connection*> connections; // indexed by fd
+    vector<thread> workers;
+
+    mutex queue_lock;
+    condition_variable queue_ready;
+    deque<Job*> queued;
+    bool stopping;
+
+    mutex done_lock;
+    vector<Job*> done;
+
+    void workerLoop();
+    void acceptClients();
+    void readFrom(Connection* connection);
+    void writeTo(Connection* connection);
+    void dispatch(Connection* connection);
+    void finishJobs();
+    void updateInterest(Connection* connection);
+    bool closeIfFinished(Connection* connection);
+
+public:
+    CommandServer(FileSystem& file_system, int worker_threads);
+    CommandServer(Handler request_handler, int worker_threads);
+    ~CommandServer();
+    CommandServer(const CommandServer&) = delete;
+    CommandServer& operator=(const CommandServer&) = delete;
+
+    // Blocks SIGINT and SIGTERM in the calling thread and so in every thread it
+    // starts afterwards. A process that serves must call this before it starts
+    // any thread, or the kernel may deliver the signal to a thread that does not
+    // block it and the process dies without shutting the server down.
+    static void blockStopSignals();
+
+    bool listen(const string& listen_address);
+    // Serves clients until SIGINT or SIGTERM; queued commands still complete.
+    void run();
+};
+
+#endif
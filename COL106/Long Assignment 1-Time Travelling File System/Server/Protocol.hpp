@@ -0,0 +1,74 @@
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+
+#include <string>
+#include <string_view>
+#include <cstdlib>
+
+using namespace std;
+
+// Wire format shared by the server and its clients. A request is one command
+// line ending in '\n'; clients may send any number of them before reading the
+// replies (pipelining). Every request gets exactly one response, in order:
+//
+//   <out bytes> <err bytes>\n<out><err>
+//
+// where out and err are what the command wrote to standard output and standard
+// error in the interactive shell.
+
+inline void appendResponse(string& wire, string_view out, string_view err) {
+    wire += to_string(out.size());
+    wire += ' ';
+    wire += to_string(err.size());
+    wire += '\n';
+    wire.append(out.data(), out.size());
+    wire.append(err.data(), err.size());
+}
+
+struct Response {
+    string out;
+    string err;
+};
+
+// Splits a byte stream into Responses as bytes arrive.
+class ResponseParser {
+private:
+    string buffer;
+    size_t pos;
+
+public:
+    ResponseParser() : pos(0) {}
+
+    void feed(const char* data, size_t size) {
+        if (pos > 0 && pos == buffer.size()) {
+            buffer.clear();
+            pos = 0;
+        }
+        buffer.append(data, size);
+    }
+
+    // Returns false until a whole response has been fed.
+    bool next(Response& response) {
+        size_t eol = buffer.find('\n', pos);
+        if (eol == string::npos) {
+            return false;
+        }
+        const char* header = buffer.c_str() + pos;
+        char* rest;
+        size_t out_size = strtoull(header, &rest, 10);
+        size_t err_size = strtoull(rest, nullptr, 10);
+        if (buffer.size() - (eol + 1) < out_size + err_size) {
+            return false;
+        }
+        response.out.assign(buffer, eol + 1, out_size);
+        response.err.assign(buffer, eol + 1 + out_size, err_size);
+        pos = eol + 1 + out_size + err_size;
+        if (pos > (1 << 20)) {
+            buffer.erase(0, pos);
+            pos = 0;
+        }
+        return true;
+    }
+};
+
+#endif
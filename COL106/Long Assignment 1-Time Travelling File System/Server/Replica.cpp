@@ -0,0 +1,214 @@
+#include "Replica.hpp"
+#include "../CLI/CommandRunner.hpp"
+#include "../CLI/CommandTokenizer.hpp"
+#include "../Storage/SnapshotImage.hpp"
+#include <vector>
+#include <iomanip>
+#include <sys/stat.h>
+
+using namespace std;
+
+// Commands that never change a FileSystem.
+static const char* const READ_ONLY_COMMANDS[] = {
+    "READ", "HISTORY", "DIFF", "AS_OF", "CHANGED_BETWEEN", "RECENT_FILES", "BIGGEST_TREES",
+    "BLOB_STATS", "SEARCH", "LS", "STATS"
+};
+
+// A checkpoint is reloaded this many times at most when the primary keeps
+// checkpointing before the follower has caught up with the log in between.
+static const int MAX_RELOAD_ATTEMPTS = 5;
+
+static chrono::steady_clock::rep steadyNow() {
+    return chrono::steady_clock::now().time_since_epoch().count();
+}
+
+Replica::Replica(const string& dir, int poll_interval_ms)
+    : data_dir(dir), poll_interval(poll_interval_ms < 1 ? 1 : poll_interval_ms), tailer(dir + "/wal.log"),
+      fs(nullptr), applied_lsn(0), log_read(0), last_change(0), caught_up_at(0), reloads(0), stopping(false) {}
+
+Replica::~Replica() {
+    stop();
+    delete fs;
+}
+
+// The primary writes each checkpoint to a new file and renames it into place,
+// so a new inode means a new checkpoint.
+bool Replica::checkpointChanged() {
+    struct stat info;
+    string version;
+    if (stat((data_dir + "/checkpoint.img").c_str(), &info) == 0) {
+        version = to_string(info.st_ino) + ":" + to_string(info.st_mtim.tv_sec) + "." + to_string(info.st_mtim.tv_nsec);
+    }
+    if (version == checkpoint_version) {
+        return false;
+    }
+    checkpoint_version = version;
+    return true;
+}
+
+// Loads the current checkpoint and the log after it into a new FileSystem, then
+// swaps it in. Commands keep using the old one until the swap.
+bool Replica::reload() {
+    for (int attempt = 0; attempt < MAX_RELOAD_ATTEMPTS; ++attempt) {
+        chrono::steady_clock::rep polled_at = steadyNow();
+        checkpointChanged();
+        FileSystem* fresh = new FileSystem();
+        if (!fresh->openReplica(data_dir)) {
+            delete fresh;
+            return false;
+        }
+        uint64_t lsn = fresh->checkpointLsn();
+        vector<LogRecord> records;
+        tailer.rewind();
+        if (!tailer.poll(lsn, records)) {
+            delete fresh;
+            return false;
+        }
+        if (!records.empty() && records.front().lsn != lsn + 1) {
+            // Checkpointed again while this one was loading.
+            delete fresh;
+            continue;
+        }
+        for (const LogRecord& record : records) {
+            if (!fresh->applyRecord(record)) {
+                cerr << "Warning: Could not apply log record " << record.lsn << " for '" << record.filename << "'." << endl;
+            }
+            lsn = record.lsn;
+        }
+
+        FileSystem* old;
+        {
+            unique_lock<shared_mutex> swapping(state_lock);
+            old = fs;
+            fs = fresh;
+            applied_lsn = lsn;
+        }
+        delete old;
+        last_change = fresh->latestChange();
+        log_read = tailer.position();
+        caught_up_at = polled_at;
+        return true;
+    }
+    cerr << "Error: The primary in '" << data_dir << "' checkpoints faster than its checkpoints can be loaded." << endl;
+    return false;
+}
+
+// Applies whatever the primary has logged since the last call. Records the log
+// no longer holds show up as a gap in lsns, or, when nothing new has been
+// logged, as a newer checkpoint than the last applied record.
+bool Replica::catchUp() {
+    chrono::steady_clock::rep polled_at = steadyNow();
+    // Checked before the log: the primary writes the checkpoint before it
+    // empties the log, so an emptied log is never paired with an old checkpoint.
+    bool new_checkpoint = checkpointChanged();
+    uint64_t applied = applied_lsn;
+    vector<LogRecord> records;
+    if (!tailer.poll(applied, records)) {
+        return false;
+    }
+    log_read = tailer.position();
+    if (!records.empty() && records.front().lsn != applied + 1) {
+        reloads++;
+        return reload();
+    }
+    if (records.empty() && new_checkpoint) {
+        bool missing = false;
+        SnapshotImage* image = SnapshotImage::open(data_dir + "/checkpoint.img", missing);
+        uint64_t checkpoint_lsn = image != nullptr ? image->lsn() : 0;
+        delete image;
+        if (checkpoint_lsn > applied) {
+            reloads++;
+            return reload();
+        }
+    }
+
+    if (!records.empty()) {
+        shared_lock<shared_mutex> applying(state_lock);
+        for (const LogRecord& record : records) {
+            if (!fs->applyRecord(record)) {
+                cerr << "Warning: Could not apply log record " << record.lsn << " for '" << record.filename << "'." << endl;
+            }
+            applied_lsn = record.lsn;
+            last_change = record.timestamp;
+        }
+    }
+    caught_up_at = polled_at;
+    return true;
+}
+
+void Replica::followLoop() {
+    unique_lock<mutex> guard(wait_lock);
+    while (!stopping) {
+        guard.unlock();
+        catchUp();
+        guard.lock();
+        wake.wait_for(guard, poll_interval, [this] { return stopping; });
+    }
+}
+
+bool Replica::start() {
+    if (!reload()) {
+        return false;
+    }
+    follower = thread(&Replica::followLoop, this);
+    return true;
+}
+
+void Replica::stop() {
+    {
+        lock_guard<mutex> guard(wait_lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    if (follower.joinable()) {
+        follower.join();
+    }
+}
+
+void Replica::run(string_view line, ostream& out, ostream& err) {
+    CommandTokenizer tok(line);
+    string_view command;
+    if (!tok.next(command)) {
+        return;
+    }
+    if (command == "REPLICATION") {
+        REPLICATION(out);
+        return;
+    }
+    bool read_only = false;
+    for (const char* name : READ_ONLY_COMMANDS) {
+        read_only = read_only || command == name;
+    }
+    if (!read_only) {
+        err << "Error: Command '" << command << "' is not available on a read-only replica." << endl;
+        return;
+    }
+    shared_lock<shared_mutex> reading(state_lock);
+    runCommand(*fs, line, out, err);
+}
+
+// Records reach the log file up to LOG_SYNC_INTERVAL_MS after the primary made
+// them, so that delay is added to the time since the last complete poll. The
+// unapplied bytes are the log's current size past what the last poll read; a
+// log emptied by a checkpoint since then counts from its start.
+void Replica::REPLICATION(ostream& out) {
+    uint64_t applied = applied_lsn;
+    Timestamp change = last_change;
+    double since_poll = chrono::duration<double>(chrono::steady_clock::duration(steadyNow() - caught_up_at)).count();
+    double buffered = LOG_SYNC_INTERVAL_MS / 1000.0;
+    uint64_t read = log_read;
+    uint64_t unapplied = 0;
+    struct stat info;
+    if (stat((data_dir + "/wal.log").c_str(), &info) == 0) {
+        uint64_t size = info.st_size;
+        unapplied = size >= read ? size - read : size;
+    }
+    out << "Following '" << data_dir << "'." << '\n';
+    out << "Applied log sequence number: " << applied << '\n';
+    out << "Logged since the last poll: " << unapplied << " bytes" << '\n';
+    out << "Last applied change: " << (change > 0 ? formatTimestamp(change) : "none") << '\n';
+    out << fixed << setprecision(3) << "Staleness: at most " << since_poll + buffered << " seconds (last poll "
+        << since_poll << " seconds ago, plus up to " << buffered << " seconds the primary buffers its log)"
+        << defaultfloat << '\n';
+    out << "Checkpoint reloads: " << reloads << '\n';
+}
@@ -0,0 +1,75 @@
+#ifndef REPLICA_HPP
+#define REPLICA_HPP
+
+#include "../File/FileSystem.hpp"
+#include "../Storage/LogTailer.hpp"
+#include <string>
+#include <string_view>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <chrono>
+
+using namespace std;
+
+// Read-only follower of a primary started with --data. It loads the primary's
+// latest checkpoint, then tails the primary's write-ahead log from a background
+// thread and applies each new record to its own FileSystem, while serving the
+// read-only commands from any number of threads. The primary is never locked or
+// contacted; the two processes share only the data directory.
+//
+// When a checkpoint on the primary empties the log before the follower has read
+// every record, the missing records only exist in the new checkpoint, so the
+// follower loads it into a fresh FileSystem and swaps that in.
+class Replica {
+private:
+    string data_dir;
+    chrono::milliseconds poll_interval;
+    LogTailer tailer;
+
+    // Commands and record application share state_lock; only swapping in a
+    // reloaded FileSystem takes it exclusively.
+    shared_mutex state_lock;
+    FileSystem* fs;
+
+    atomic<uint64_t> applied_lsn;
+    atomic<uint64_t> log_read;     // bytes of the log decoded by the last poll
+    string checkpoint_version;     // identifies the checkpoint file last looked at
+    atomic<Timestamp> last_change; // timestamp of the last applied record
+    // Steady-clock time of the last poll after which every record then in the
+    // log had been applied; nothing written before it is missing here.
+    atomic<chrono::steady_clock::rep> caught_up_at;
+    atomic<int> reloads;
+
+    mutex wait_lock;
+    condition_variable wake;
+    bool stopping;
+    thread follower;
+
+    bool checkpointChanged();
+    bool reload();
+    bool catchUp();
+    void followLoop();
+
+public:
+    Replica(const string& dir, int poll_interval_ms);
+    ~Replica();
+    Replica(const Replica&) = delete;
+    Replica& operator=(const Replica&) = delete;
+
+    // Loads the checkpoint, applies the log written since and starts following it.
+    bool start();
+    void stop();
+
+    // Runs one command line. Read-only commands run against the follower's
+    // FileSystem; commands that would change it are refused.
+    void run(string_view line, ostream& out = cout, ostream& err = cerr);
+    // Prints how far the follower has got through the primary's log, how much
+    // the primary has logged since the last poll and how stale its view can be.
+    void REPLICATION(ostream& out = cout);
+};
+
+#endif
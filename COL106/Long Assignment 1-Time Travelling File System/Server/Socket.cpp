@@ -0,0 +1,144 @@
+#include "Socket.hpp"
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+static bool isTcpAddress(const string& address) {
+    return address.find(':') != string::npos;
+}
+
+static bool tcpAddress(const string& address, sockaddr_in& addr, string& error) {
+    size_t colon = address.rfind(':');
+    string host = address.substr(0, colon);
+    int port = atoi(address.c_str() + colon + 1);
+    if (host.empty()) {
+        host = "127.0.0.1";
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (port <= 0 || port > 65535 || inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+        error = "invalid TCP address '" + address + "'";
+        return false;
+    }
+    return true;
+}
+
+static bool unixAddress(const string& path, sockaddr_un& addr, string& error) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        error = "invalid socket path '" + path + "'";
+        return false;
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+int listenOn(const string& address, string& error) {
+    int fd;
+    if (isTcpAddress(address)) {
+        sockaddr_in addr;
+        if (!tcpAddress(address, addr, error)) {
+            return -1;
+        }
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (fd >= 0 && bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            error = "cannot bind " + address + ": " + strerror(errno);
+            close(fd);
+            return -1;
+        }
+    } else {
+        sockaddr_un addr;
+        if (!unixAddress(address, addr, error)) {
+            return -1;
+        }
+        // A socket file left behind by a previous run would make bind fail;
+        // anything else at the path is not ours to delete.
+        struct stat info;
+        if (lstat(address.c_str(), &info) == 0) {
+            if (!S_ISSOCK(info.st_mode)) {
+                error = "cannot bind " + address + ": the path exists and is not a socket";
+                return -1;
+            }
+            unlink(address.c_str());
+        }
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            error = "cannot bind " + address + ": " + strerror(errno);
+            close(fd);
+            return -1;
+        }
+    }
+    if (fd < 0 || listen(fd, SOMAXCONN) != 0) {
+        error = string("cannot listen: ") + strerror(errno);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+void removeSocketFile(const string& address) {
+    struct stat info;
+    if (!isTcpAddress(address) && lstat(address.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(address.c_str());
+    }
+}
+
+int connectTo(const string& address, string& error) {
+    int fd;
+    int result;
+    if (isTcpAddress(address)) {
+        sockaddr_in addr;
+        if (!tcpAddress(address, addr, error)) {
+            return -1;
+        }
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        result = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    } else {
+        sockaddr_un addr;
+        if (!unixAddress(address, addr, error)) {
+            return -1;
+        }
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        result = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    }
+    if (fd < 0 || result != 0) {
+        error = "cannot connect to " + address + ": " + strerror(errno);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+bool sendAll(int fd, const char* data, size_t size) {
+    size_t sent = 0;
+    while (sent < size) {
+        ssize_t n = send(fd, data + sent, size - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
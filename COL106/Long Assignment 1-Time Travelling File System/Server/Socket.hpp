@@ -0,0 +1,23 @@
+#ifndef SOCKET_HPP
+#define SOCKET_HPP
+
+#include <string>
+
+using namespace std;
+
+// An address is either "host:port" for TCP (an empty host means 127.0.0.1)
+// or anything else, which is taken as the path of a Unix domain socket.
+// Both functions return a socket descriptor, or -1 with `error` set.
+
+// listenOn replaces a socket file left at a Unix address by an earlier run,
+// but refuses to remove anything else found at that path.
+int listenOn(const string& address, string& error);
+int connectTo(const string& address, string& error);
+// Removes the socket file of a Unix address once its server is done with it;
+// does nothing for TCP addresses or paths that are no longer sockets.
+void removeSocketFile(const string& address);
+
+// Writes all of `data`, retrying short writes. Never raises SIGPIPE.
+bool sendAll(int fd, const char* data, size_t size);
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef BINARYIO_HPP
+#define BINARYIO_HPP
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+#include <array>
+
+using namespace std;
+
+inline uint32_t crc32(const char* data, size_t size, uint32_t crc = 0) {
+    // Built once; the initialization of a function-local static is thread-safe.
+    static const array<uint32_t, 256> table = [] {
+        array<uint32_t, 256> entries;
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[i] = c;
+        }
+        return entries;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Appends little-endian fixed-width integers and length-prefixed strings to a buffer.
+class BinaryWriter {
+private:
+    string& out;
+
+    template <typename T>
+    void putRaw(T val) {
+        char bytes[sizeof(T)];
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            bytes[i] = static_cast<char>((static_cast<uint64_t>(val) >> (8 * i)) & 0xFF);
+        }
+        out.append(bytes, sizeof(T));
+    }
+
+public:
+    BinaryWriter(string& buffer) : out(buffer) {}
+
+    void putU8(uint8_t val) { putRaw(val); }
+    void putU32(uint32_t val) { putRaw(val); }
+    void putI32(int32_t val) { putRaw(static_cast<uint32_t>(val)); }
+    void putU64(uint64_t val) { putRaw(val); }
+    void putI64(int64_t val) { putRaw(static_cast<uint64_t>(val)); }
+
+    void putString(string_view s) {
+        putU32(s.size());
+        out.append(s.data(), s.size());
+    }
+
+    // Overwrites a u32 written earlier at `offset`, for sizes only known afterwards.
+    void patchU32(size_t offset, uint32_t val) {
+        for (size_t i = 0; i < 4; ++i) {
+            out[offset + i] = static_cast<char>((val >> (8 * i)) & 0xFF);
+        }
+    }
+
+    size_t size() const { return out.size(); }
+};
+
+// Reads values written by BinaryWriter. Reading past the end clears ok() and
+// yields zeros, so callers can check once after decoding a whole record.
+class BinaryReader {
+private:
+    const char* data;
+    size_t length;
+    size_t pos;
+    bool valid;
+
+    template <typename T>
+    T getRaw() {
+        if (length - pos < sizeof(T)) {
+            valid = false;
+            pos = length;
+            return 0;
+        }
+        uint64_t val = 0;
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            val |= static_cast<uint64_t>(static_cast<unsigned char>(data[pos + i])) << (8 * i);
+        }
+        pos += sizeof(T);
+        return static_cast<T>(val);
+    }
+
+public:
+    BinaryReader(const char* bytes, size_t size) : data(bytes), length(size), pos(0), valid(true) {}
+
+    uint8_t getU8() { return getRaw<uint8_t>(); }
+    uint32_t getU32() { return getRaw<uint32_t>(); }
+    int32_t getI32() { return static_cast<int32_t>(getRaw<uint32_t>()); }
+    uint64_t getU64() { return getRaw<uint64_t>(); }
+    int64_t getI64() { return static_cast<int64_t>(getRaw<uint64_t>()); }
+
+    string getString() {
+        uint32_t size = getU32();
+        if (length - pos < size) {
+            valid = false;
+            pos = length;
+            return "";
+        }
+        string s(data + pos, size);
+        pos += size;
+        return s;
+    }
+
+    bool ok() const { return valid; }
+    size_t position() const { return pos; }
+    size_t remaining() const { return length - pos; }
+};
+
+#endif
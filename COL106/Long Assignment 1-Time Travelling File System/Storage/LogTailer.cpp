@@ -0,0 +1,86 @@
+#include "LogTailer.hpp"
+#include "BinaryIO.hpp"
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+LogTailer::LogTailer(const string& log_path)
+    : path(log_path), fd(-1), offset(0), head_lsn(0) {}
+
+LogTailer::~LogTailer() {
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+// The lsn is the first field of a record's payload, right after its 8-byte frame header.
+bool LogTailer::readHeadLsn(uint64_t& lsn) const {
+    char bytes[8];
+    if (pread(fd, bytes, sizeof(bytes), 8) != sizeof(bytes)) {
+        return false;
+    }
+    lsn = BinaryReader(bytes, sizeof(bytes)).getU64();
+    return true;
+}
+
+bool LogTailer::poll(uint64_t after_lsn, vector<LogRecord>& records) {
+    if (fd == -1) {
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            return true;
+        }
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        cerr << "Error: Could not stat write-ahead log '" << path << "'." << endl;
+        return false;
+    }
+    uint64_t size = info.st_size;
+
+    if (offset > 0) {
+        uint64_t lsn = 0;
+        if (size < offset || !readHeadLsn(lsn) || lsn != head_lsn) {
+            rewind();
+        }
+    }
+    if (size <= offset) {
+        return true;
+    }
+
+    buffer.resize(size - offset);
+    size_t filled = 0;
+    while (filled < buffer.size()) {
+        ssize_t n = pread(fd, &buffer[filled], buffer.size() - filled, offset + filled);
+        if (n < 0) {
+            cerr << "Error: Read from write-ahead log '" << path << "' failed." << endl;
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        filled += n;
+    }
+
+    vector<LogRecord> decoded;
+    size_t consumed = WriteAheadLog::parse(buffer.data(), filled, decoded);
+    if (offset == 0 && !decoded.empty()) {
+        head_lsn = decoded.front().lsn;
+    }
+    offset += consumed;
+    for (LogRecord& record : decoded) {
+        if (record.lsn > after_lsn) {
+            records.push_back(std::move(record));
+        }
+    }
+    return true;
+}
+
+void LogTailer::rewind() {
+    offset = 0;
+    head_lsn = 0;
+}
+
+uint64_t LogTailer::position() const { return offset; }
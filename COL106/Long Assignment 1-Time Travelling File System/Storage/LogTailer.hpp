@@ -0,0 +1,45 @@
+#ifndef LOGTAILER_HPP
+#define LOGTAILER_HPP
+
+#include "WriteAheadLog.hpp"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+// Follows a write-ahead log that another process is appending to, returning the
+// records added since the last poll. Only whole, intact frames are returned; a
+// frame still being written is picked up by a later poll.
+//
+// The writer empties the log after every checkpoint. The tailer notices by the
+// file shrinking below its position or by a different record now sitting at the
+// start of the file, and then reads the log again from the start.
+class LogTailer {
+private:
+    string path;
+    int fd;
+    uint64_t offset;   // bytes of the log already decoded
+    uint64_t head_lsn; // lsn of the first record in the log, 0 before it is read
+    string buffer;
+
+    bool readHeadLsn(uint64_t& lsn) const;
+
+public:
+    explicit LogTailer(const string& log_path);
+    ~LogTailer();
+    LogTailer(const LogTailer&) = delete;
+    LogTailer& operator=(const LogTailer&) = delete;
+
+    // Appends the new records whose lsn is above after_lsn to `records`. If the
+    // log was emptied since the previous poll, records between after_lsn and the
+    // first one returned may only be in the checkpoint; callers compare lsns to
+    // find out. A log that does not exist yet simply has no records.
+    bool poll(uint64_t after_lsn, vector<LogRecord>& records);
+    // Reads the whole log again on the next poll.
+    void rewind();
+    // Bytes of the log decoded so far; what lies beyond is not yet returned.
+    uint64_t position() const;
+};
+
+#endif
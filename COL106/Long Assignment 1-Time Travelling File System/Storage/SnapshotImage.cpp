@@ -0,0 +1,323 @@
+#include "SnapshotImage.hpp"
+#include "BinaryIO.hpp"
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static_assert(sizeof(ImageHeader) == 96, "ImageHeader layout changed");
+static_assert(sizeof(ImageFileRecord) == 56, "ImageFileRecord layout changed");
+static_assert(sizeof(ImageNodeRecord) == 64, "ImageNodeRecord layout changed");
+static_assert(sizeof(ImageActivationRecord) == 16, "ImageActivationRecord layout changed");
+static_assert(sizeof(ImageEventRecord) == 24, "ImageEventRecord layout changed");
+
+static const char IMAGE_MAGIC[8] = {'T', 'T', 'F', 'S', 'I', 'M', 'G', '4'};
+static const size_t WRITE_BUFFER_SIZE = 1 << 20;
+
+static uint32_t imageChecksum(ImageHeader header, const char* file_table, size_t file_table_size) {
+    header.crc = 0;
+    uint32_t crc = crc32(reinterpret_cast<const char*>(&header), sizeof(header));
+    return crc32(file_table, file_table_size, crc);
+}
+
+// Whether `count` records of `record_size` bytes starting at `off` lie inside the mapping.
+static bool fits(uint64_t off, uint64_t count, size_t record_size, size_t length) {
+    return off <= length && count <= (length - off) / record_size;
+}
+
+static bool stringFits(const ImageHeader& header, uint64_t off, uint32_t len) {
+    return off <= header.string_size && len <= header.string_size - off;
+}
+
+// The checksum only covers the header and the file table, so every index and
+// range the other tables hold is checked once here and trusted by the readers.
+// This reads the node table but none of the content it points to.
+static bool validTables(const char* base, const ImageHeader& header) {
+    vector<int32_t> versions_of(header.file_count, 0); // by file id, 0 until seen
+    vector<char> live;
+    for (uint32_t index = 0; index < header.file_count; ++index) {
+        ImageFileRecord file;
+        memcpy(&file, base + header.file_off + index * sizeof(ImageFileRecord), sizeof(file));
+        if (!stringFits(header, file.name_off, file.name_len)
+            || file.file_id < 0 || static_cast<uint32_t>(file.file_id) >= header.file_count
+            || versions_of[file.file_id] != 0
+            || file.num_nodes <= 0 || file.first_node > header.node_count
+            || static_cast<uint64_t>(file.num_nodes) > header.node_count - file.first_node
+            || file.first_activation > header.activation_count
+            || file.num_activations > header.activation_count - file.first_activation
+            || file.active_id < 0 || file.active_id >= file.num_nodes) {
+            return false;
+        }
+        versions_of[file.file_id] = file.num_nodes;
+
+        // Parents and merge parents come before their children and survive
+        // garbage collection, so each must be a live, smaller version id.
+        live.assign(file.num_nodes, 0);
+        int32_t live_count = 0;
+        for (int32_t id = 0; id < file.num_nodes; ++id) {
+            ImageNodeRecord node;
+            memcpy(&node, base + header.node_off + (file.first_node + id) * sizeof(ImageNodeRecord), sizeof(node));
+            if (node.flags & IMAGE_NODE_PRUNED) {
+                continue;
+            }
+            bool parent_ok = id == 0 ? node.parent == -1 : node.parent >= 0 && node.parent < id && live[node.parent];
+            bool merge_ok = node.merge_parent == -1
+                || (node.merge_parent >= 0 && node.merge_parent < id && live[node.merge_parent]);
+            if (!parent_ok || !merge_ok || !stringFits(header, node.message_off, node.message_len)
+                || !stringFits(header, node.delta_off, node.delta_len)) {
+                return false;
+            }
+            live[id] = 1;
+            live_count++;
+        }
+        if (live_count != file.live_nodes || !live[file.active_id]) {
+            return false;
+        }
+
+        // Activations may name versions garbage collection has pruned since.
+        for (uint32_t i = 0; i < file.num_activations; ++i) {
+            ImageActivationRecord activation;
+            memcpy(&activation, base + header.activation_off + (file.first_activation + i) * sizeof(ImageActivationRecord),
+                   sizeof(activation));
+            if (activation.version_id < 0 || activation.version_id >= file.num_nodes) {
+                return false;
+            }
+        }
+    }
+
+    for (uint64_t i = 0; i < header.event_count; ++i) {
+        ImageEventRecord event;
+        memcpy(&event, base + header.event_off + i * sizeof(ImageEventRecord), sizeof(event));
+        if (event.file_id < 0 || static_cast<uint32_t>(event.file_id) >= header.file_count
+            || event.version_id < 0 || event.version_id >= versions_of[event.file_id]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool writeAll(int fd, const char* data, size_t size) {
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = write(fd, data + written, size - written);
+        if (n < 0) {
+            return false;
+        }
+        written += n;
+    }
+    return true;
+}
+
+SnapshotImage::SnapshotImage(const char* mapping, size_t length, const ImageHeader& h)
+    : base(mapping), size(length), header(h) {}
+
+SnapshotImage::~SnapshotImage() {
+    munmap(const_cast<char*>(base), size);
+}
+
+SnapshotImage* SnapshotImage::open(const string& path, bool& missing) {
+    missing = false;
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        missing = errno == ENOENT;
+        if (!missing) {
+            cerr << "Error: Could not open checkpoint '" << path << "'." << endl;
+        }
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(ImageHeader)) {
+        close(fd);
+        cerr << "Error: '" << path << "' is not a checkpoint image." << endl;
+        return nullptr;
+    }
+    size_t length = st.st_size;
+    void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        cerr << "Error: Could not map checkpoint '" << path << "'." << endl;
+        return nullptr;
+    }
+    const char* base = static_cast<const char*>(mapping);
+
+    ImageHeader header;
+    memcpy(&header, base, sizeof(header));
+    size_t file_table_size = static_cast<size_t>(header.file_count) * sizeof(ImageFileRecord);
+    bool valid = memcmp(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) == 0
+        && fits(header.string_off, header.string_size, 1, length)
+        && fits(header.node_off, header.node_count, sizeof(ImageNodeRecord), length)
+        && fits(header.activation_off, header.activation_count, sizeof(ImageActivationRecord), length)
+        && fits(header.event_off, header.event_count, sizeof(ImageEventRecord), length)
+        && fits(header.file_off, header.file_count, sizeof(ImageFileRecord), length)
+        && imageChecksum(header, base + header.file_off, file_table_size) == header.crc
+        && validTables(base, header);
+    if (!valid) {
+        munmap(mapping, length);
+        cerr << "Error: Checkpoint image '" << path << "' is corrupt." << endl;
+        return nullptr;
+    }
+    return new SnapshotImage(base, length, header);
+}
+
+uint64_t SnapshotImage::lsn() const { return header.lsn; }
+uint32_t SnapshotImage::fileCount() const { return header.file_count; }
+
+ImageFileRecord SnapshotImage::file(uint32_t index) const {
+    ImageFileRecord record;
+    memcpy(&record, base + header.file_off + index * sizeof(ImageFileRecord), sizeof(record));
+    return record;
+}
+
+ImageNodeRecord SnapshotImage::node(uint64_t index) const {
+    ImageNodeRecord record;
+    memcpy(&record, base + header.node_off + index * sizeof(ImageNodeRecord), sizeof(record));
+    return record;
+}
+
+ImageActivationRecord SnapshotImage::activation(uint64_t index) const {
+    ImageActivationRecord record;
+    memcpy(&record, base + header.activation_off + index * sizeof(ImageActivationRecord), sizeof(record));
+    return record;
+}
+
+uint64_t SnapshotImage::eventCount() const { return header.event_count; }
+
+ImageEventRecord SnapshotImage::event(uint64_t index) const {
+    ImageEventRecord record;
+    memcpy(&record, base + header.event_off + index * sizeof(ImageEventRecord), sizeof(record));
+    return record;
+}
+
+string_view SnapshotImage::str(uint64_t off, uint32_t len) const {
+    if (off + len > header.string_size) {
+        return string_view();
+    }
+    return string_view(base + header.string_off + off, len);
+}
+
+SnapshotImageWriter::SnapshotImageWriter(const string& image_path)
+    : path(image_path), tmp_path(image_path + ".tmp"), fd(-1), failed(false), string_size(0) {}
+
+SnapshotImageWriter::~SnapshotImageWriter() {
+    if (fd != -1) {
+        close(fd);
+        unlink(tmp_path.c_str());
+    }
+}
+
+bool SnapshotImageWriter::begin() {
+    fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        cerr << "Error: Could not write checkpoint '" << tmp_path << "'." << endl;
+        return false;
+    }
+    buffer.assign(sizeof(ImageHeader), '\0');
+    return true;
+}
+
+void SnapshotImageWriter::flushBuffer() {
+    if (!failed && !writeAll(fd, buffer.data(), buffer.size())) {
+        failed = true;
+    }
+    buffer.clear();
+}
+
+uint64_t SnapshotImageWriter::putString(string_view s) {
+    uint64_t off = string_size;
+    buffer.append(s.data(), s.size());
+    string_size += s.size();
+    if (buffer.size() >= WRITE_BUFFER_SIZE) {
+        flushBuffer();
+    }
+    return off;
+}
+
+uint64_t SnapshotImageWriter::beginFile(const string& name, int file_id, int64_t last_change, int active_id) {
+    ImageFileRecord record;
+    record.name_off = putString(name);
+    record.name_len = name.size();
+    record.first_node = nodes.size();
+    record.first_activation = activations.size();
+    record.last_change = last_change;
+    record.file_id = file_id;
+    record.active_id = active_id;
+    record.num_nodes = 0;
+    record.live_nodes = 0;
+    record.num_activations = 0;
+    files.push_back(record);
+    return record.first_node;
+}
+
+void SnapshotImageWriter::addNode(int parent, int merge_parent, bool replaces_parent, int64_t created,
+                                  int64_t snapshot, int64_t modified, string_view message, string_view delta,
+                                  uint32_t flags) {
+    ImageNodeRecord record;
+    record.message_off = putString(message);
+    record.message_len = message.size();
+    record.delta_off = putString(delta);
+    record.delta_len = delta.size();
+    record.created = created;
+    record.snapshot = snapshot;
+    record.modified = modified;
+    record.parent = parent;
+    record.merge_parent = merge_parent;
+    record.replaces_parent = replaces_parent ? 1 : 0;
+    record.flags = flags;
+    nodes.push_back(record);
+    files.back().num_nodes++;
+    if (!(flags & IMAGE_NODE_PRUNED)) {
+        files.back().live_nodes++;
+    }
+}
+
+void SnapshotImageWriter::addActivation(int64_t time, int version_id) {
+    activations.push_back(ImageActivationRecord{time, version_id, 0});
+    files.back().num_activations++;
+}
+
+void SnapshotImageWriter::addEvent(int64_t time, int file_id, int version_id, uint32_t op) {
+    events.push_back(ImageEventRecord{time, file_id, version_id, op, 0});
+}
+
+bool SnapshotImageWriter::finish(uint64_t lsn) {
+    ImageHeader header;
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+    header.lsn = lsn;
+    header.string_off = sizeof(ImageHeader);
+    header.string_size = string_size;
+    header.node_off = header.string_off + string_size;
+    header.node_count = nodes.size();
+    header.activation_off = header.node_off + nodes.size() * sizeof(ImageNodeRecord);
+    header.activation_count = activations.size();
+    header.event_off = header.activation_off + activations.size() * sizeof(ImageActivationRecord);
+    header.event_count = events.size();
+    header.file_off = header.event_off + events.size() * sizeof(ImageEventRecord);
+    header.file_count = files.size();
+
+    const char* file_table = reinterpret_cast<const char*>(files.data());
+    size_t file_table_size = files.size() * sizeof(ImageFileRecord);
+    header.crc = imageChecksum(header, file_table, file_table_size);
+
+    buffer.append(reinterpret_cast<const char*>(nodes.data()), nodes.size() * sizeof(ImageNodeRecord));
+    buffer.append(reinterpret_cast<const char*>(activations.data()), activations.size() * sizeof(ImageActivationRecord));
+    buffer.append(reinterpret_cast<const char*>(events.data()), events.size() * sizeof(ImageEventRecord));
+    buffer.append(file_table, file_table_size);
+    flushBuffer();
+    bool ok = !failed
+        && pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header))
+        && fsync(fd) == 0;
+    close(fd);
+    fd = -1;
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        cerr << "Error: Could not write checkpoint '" << path << "'." << endl;
+        return false;
+    }
+    return true;
+}
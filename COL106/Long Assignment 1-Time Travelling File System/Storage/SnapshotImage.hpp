@@ -0,0 +1,146 @@
+#ifndef SNAPSHOTIMAGE_HPP
+#define SNAPSHOTIMAGE_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+// On-disk checkpoint of every version tree, laid out so it can be mmap'd and read
+// in place:
+//
+//   [ImageHeader][string section][node table][activation table][event table][file table]
+//
+// Nodes of a file are stored contiguously in version-id order and refer to their
+// parents by version id; messages, deltas and filenames are (offset, length) pairs
+// into the string section. A file's activations (when each version became the
+// active one) are likewise contiguous and in time order. The event table holds
+// every change to any file, sorted by time. Timestamps are microseconds. Nothing in the image is a pointer, so it is valid at any
+// mapping address. Integers are stored in host byte order.
+
+struct ImageHeader {
+    char magic[8];
+    uint64_t lsn;          // last log record the image covers
+    uint64_t string_off;
+    uint64_t string_size;
+    uint64_t node_off;
+    uint64_t node_count;
+    uint64_t activation_off;
+    uint64_t activation_count;
+    uint64_t event_off;
+    uint64_t event_count;
+    uint64_t file_off;
+    uint32_t file_count;
+    uint32_t crc;          // crc32 of the header (with crc = 0) and the file table
+};
+
+struct ImageFileRecord {
+    uint64_t name_off;
+    uint64_t first_node;
+    uint64_t first_activation;
+    int64_t last_change;
+    uint32_t name_len;
+    int32_t file_id;
+    int32_t active_id;
+    int32_t num_nodes;     // one per version id, including pruned ones
+    int32_t live_nodes;
+    uint32_t num_activations;
+};
+
+enum ImageNodeFlags : uint32_t {
+    IMAGE_NODE_TAGGED = 1,
+    IMAGE_NODE_PRUNED = 2  // removed by garbage collection; only holds its id's place
+};
+
+struct ImageNodeRecord {
+    uint64_t message_off;
+    uint64_t delta_off;
+    int64_t created;
+    int64_t snapshot;
+    int64_t modified;      // last change to the content
+    uint32_t message_len;
+    uint32_t delta_len;
+    int32_t parent;        // parent version id, -1 for the root
+    int32_t merge_parent;  // second parent of a merge version, -1 otherwise
+    uint32_t replaces_parent;
+    uint32_t flags;        // ImageNodeFlags
+};
+
+struct ImageActivationRecord {
+    int64_t time;
+    int32_t version_id;
+    uint32_t reserved;
+};
+
+struct ImageEventRecord {
+    int64_t time;
+    int32_t file_id;
+    int32_t version_id;    // active version after the change
+    uint32_t op;           // LogOp of the change
+    uint32_t reserved;
+};
+
+// Read-only view of an image file mapped into memory.
+class SnapshotImage {
+private:
+    const char* base;
+    size_t size;
+    ImageHeader header;
+
+    SnapshotImage(const char* mapping, size_t length, const ImageHeader& h);
+
+public:
+    ~SnapshotImage();
+
+    // Maps and validates `path`: the checksum and every offset, length and
+    // version id in its tables. Returns nullptr if it does not exist or is
+    // invalid; `missing` tells the two apart.
+    static SnapshotImage* open(const string& path, bool& missing);
+
+    uint64_t lsn() const;
+    uint32_t fileCount() const;
+    ImageFileRecord file(uint32_t index) const;
+    ImageNodeRecord node(uint64_t index) const;
+    ImageActivationRecord activation(uint64_t index) const;
+    uint64_t eventCount() const;
+    ImageEventRecord event(uint64_t index) const;
+    string_view str(uint64_t off, uint32_t len) const;
+};
+
+// Streams a new image to disk. String data is written as it arrives; the node and
+// file tables are kept in memory and appended by finish(), which also fsyncs the
+// file and renames it over `path`.
+class SnapshotImageWriter {
+private:
+    string path;
+    string tmp_path;
+    int fd;
+    bool failed;
+    string buffer;
+    uint64_t string_size;
+    vector<ImageNodeRecord> nodes;
+    vector<ImageActivationRecord> activations;
+    vector<ImageEventRecord> events;
+    vector<ImageFileRecord> files;
+
+    uint64_t putString(string_view s);
+    void flushBuffer();
+
+public:
+    SnapshotImageWriter(const string& image_path);
+    ~SnapshotImageWriter();
+
+    bool begin();
+    // Returns the index of the file's first node in the new image.
+    uint64_t beginFile(const string& name, int file_id, int64_t last_change, int active_id);
+    void addNode(int parent, int merge_parent, bool replaces_parent, int64_t created, int64_t snapshot,
+                 int64_t modified, string_view message, string_view delta, uint32_t flags = 0);
+    // Activations belong to the file last begun; events must be added in time order.
+    void addActivation(int64_t time, int version_id);
+    void addEvent(int64_t time, int file_id, int version_id, uint32_t op);
+    bool finish(uint64_t lsn);
+};
+
+#endif
@@ -0,0 +1,193 @@
+#include "WriteAheadLog.hpp"
+#include "BinaryIO.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+WriteAheadLog::WriteAheadLog(const string& log_path, int sync_every_records, int sync_interval_ms)
+    : path(log_path), fd(-1), pending_records(0), sync_every(sync_every_records),
+      sync_interval(sync_interval_ms), next_lsn(1), records_since_reset(0), stopping(false) {}
+
+WriteAheadLog::~WriteAheadLog() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    if (flusher.joinable()) {
+        flusher.join();
+    }
+    if (fd != -1) {
+        commitLocked();
+        close(fd);
+    }
+}
+
+bool WriteAheadLog::recover(const string& log_path, vector<LogRecord>& records) {
+    ifstream in(log_path, ios::binary);
+    if (!in) {
+        return true;
+    }
+    stringstream ss;
+    ss << in.rdbuf();
+    string data = ss.str();
+    in.close();
+
+    size_t pos = parse(data.data(), data.size(), records);
+    if (pos < data.size()) {
+        cerr << "Warning: Discarding " << data.size() - pos << " bytes of torn log tail in '" << log_path << "'." << endl;
+        if (truncate(log_path.c_str(), pos) != 0) {
+            cerr << "Error: Could not truncate '" << log_path << "'." << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t WriteAheadLog::parse(const char* data, size_t size, vector<LogRecord>& records) {
+    size_t pos = 0;
+    while (size - pos >= 8) {
+        BinaryReader header(data + pos, 8);
+        uint32_t payload_size = header.getU32();
+        uint32_t crc = header.getU32();
+        if (size - pos - 8 < payload_size || crc32(data + pos + 8, payload_size) != crc) {
+            break;
+        }
+        BinaryReader body(data + pos + 8, payload_size);
+        LogRecord record;
+        record.lsn = body.getU64();
+        record.op = static_cast<LogOp>(body.getU8());
+        record.timestamp = body.getI64();
+        record.filename = body.getString();
+        record.text = body.getString();
+        record.version_id = body.getI32();
+        record.other_version_id = body.getI32();
+        if (!body.ok()) {
+            break;
+        }
+        records.push_back(std::move(record));
+        pos += 8 + payload_size;
+    }
+    return pos;
+}
+
+bool WriteAheadLog::open(uint64_t first_lsn) {
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd == -1) {
+        cerr << "Error: Could not open write-ahead log '" << path << "'." << endl;
+        return false;
+    }
+    next_lsn = first_lsn;
+    flusher = thread(&WriteAheadLog::flushLoop, this);
+    return true;
+}
+
+// Sleeps until the oldest pending record has waited sync_interval, then commits.
+// Records committed by append() in the meantime just move the deadline.
+void WriteAheadLog::flushLoop() {
+    unique_lock<mutex> guard(lock);
+    while (!stopping) {
+        if (pending_records == 0) {
+            wake.wait(guard);
+            continue;
+        }
+        chrono::steady_clock::time_point due = first_pending + sync_interval;
+        if (chrono::steady_clock::now() >= due) {
+            commitLocked();
+            continue;
+        }
+        wake.wait_until(guard, due);
+    }
+}
+
+uint64_t WriteAheadLog::append(LogOp op, int64_t timestamp, string_view filename, string_view text,
+                               int version_id, int other_version_id) {
+    lock_guard<mutex> guard(lock);
+    uint64_t lsn = next_lsn++;
+    size_t frame = pending.size();
+    BinaryWriter out(pending);
+    out.putU32(0); // payload size and crc, filled in once the payload is written
+    out.putU32(0);
+    out.putU64(lsn);
+    out.putU8(op);
+    out.putI64(timestamp);
+    out.putString(filename);
+    out.putString(text);
+    out.putI32(version_id);
+    out.putI32(other_version_id);
+    size_t payload_size = pending.size() - frame - 8;
+    out.patchU32(frame, payload_size);
+    out.patchU32(frame + 4, crc32(pending.data() + frame + 8, payload_size));
+    records_since_reset++;
+
+    if (++pending_records >= sync_every) {
+        commitLocked();
+    } else if (pending_records == 1) {
+        first_pending = chrono::steady_clock::now();
+        wake.notify_one();
+    }
+    return lsn;
+}
+
+bool WriteAheadLog::commit() {
+    lock_guard<mutex> guard(lock);
+    return commitLocked();
+}
+
+// A failed write may already have put part of the buffer in the file, so that
+// part is dropped from the buffer; the next commit continues right after it
+// instead of writing it a second time, which would leave a torn frame in the
+// middle of the log and cut every later record off at recovery.
+bool WriteAheadLog::commitLocked() {
+    if (fd == -1) {
+        return false;
+    }
+    size_t written = 0;
+    while (written < pending.size()) {
+        ssize_t n = write(fd, pending.data() + written, pending.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            pending.erase(0, written);
+            cerr << "Error: Write to '" << path << "' failed." << endl;
+            return false;
+        }
+        written += n;
+    }
+    pending.clear();
+    pending_records = 0;
+    if (fsync(fd) != 0) {
+        cerr << "Error: fsync of '" << path << "' failed." << endl;
+        return false;
+    }
+    return true;
+}
+
+bool WriteAheadLog::reset() {
+    lock_guard<mutex> guard(lock);
+    if (!commitLocked()) {
+        return false;
+    }
+    if (ftruncate(fd, 0) != 0 || fsync(fd) != 0) {
+        cerr << "Error: Could not reset write-ahead log '" << path << "'." << endl;
+        return false;
+    }
+    records_since_reset = 0;
+    return true;
+}
+
+uint64_t WriteAheadLog::nextLsn() const {
+    lock_guard<mutex> guard(lock);
+    return next_lsn;
+}
+
+long long WriteAheadLog::recordsSinceReset() const {
+    lock_guard<mutex> guard(lock);
+    return records_since_reset;
+}
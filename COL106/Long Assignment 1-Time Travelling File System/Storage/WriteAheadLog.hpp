@@ -0,0 +1,94 @@
+#ifndef WRITEAHEADLOG_HPP
+#define WRITEAHEADLOG_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+using namespace std;
+
+enum LogOp : uint8_t {
+    LOG_CREATE = 1,
+    LOG_INSERT = 2,
+    LOG_UPDATE = 3,
+    LOG_SNAPSHOT = 4,
+    LOG_ROLLBACK = 5,
+    LOG_MERGE = 6,
+    LOG_TAG = 7,
+    LOG_GC = 8
+};
+
+// Default bound on how long a record waits in the buffer before it is written
+// to the log file, where followers can see it.
+const int LOG_SYNC_INTERVAL_MS = 50;
+
+// One mutating command together with the timestamp it was applied at, so replay
+// reproduces the exact same version trees.
+struct LogRecord {
+    uint64_t lsn;
+    LogOp op;
+    int64_t timestamp; // microseconds since the epoch
+    string filename;
+    string text;     // content for INSERT/UPDATE, message for SNAPSHOT
+    int version_id;  // target for ROLLBACK and TAG, first version for MERGE, keep_last for GC
+    int other_version_id; // second version for MERGE
+};
+
+// Append-only binary log of LogRecords. Each record is framed as
+// [u32 payload size][u32 crc32][payload], so a torn write at the tail is detected
+// on recovery and cut off.
+//
+// Records are buffered and made durable together (group commit): the buffer is
+// written and fsync'd once sync_every records are pending, and always on commit()
+// and destruction. A background thread commits records that have been pending
+// for sync_interval_ms, so the last records of a burst are not left waiting for
+// a next record that may never come. All members are safe to call from any thread.
+class WriteAheadLog {
+private:
+    string path;
+    int fd;
+    mutable mutex lock; // everything below, shared with the flusher thread
+    string pending;
+    int pending_records;
+    int sync_every;
+    chrono::milliseconds sync_interval;
+    chrono::steady_clock::time_point first_pending; // when the oldest pending record was appended
+    uint64_t next_lsn;
+    long long records_since_reset;
+    condition_variable wake;
+    bool stopping;
+    thread flusher;
+
+    bool commitLocked();
+    void flushLoop();
+
+public:
+    WriteAheadLog(const string& log_path, int sync_every_records = 64, int sync_interval_ms = LOG_SYNC_INTERVAL_MS);
+    ~WriteAheadLog();
+
+    // Reads every intact record and truncates a torn tail. Returns false if the
+    // log exists but cannot be read.
+    static bool recover(const string& log_path, vector<LogRecord>& records);
+    // Decodes the intact records at the start of `data` and returns how many
+    // bytes they take up; decoding stops at the first incomplete or corrupt frame.
+    static size_t parse(const char* data, size_t size, vector<LogRecord>& records);
+
+    // Opens the log for appending and starts the flusher thread.
+    bool open(uint64_t first_lsn);
+    // Frames the record straight into the pending buffer and returns its lsn.
+    uint64_t append(LogOp op, int64_t timestamp, string_view filename, string_view text = string_view(),
+                    int version_id = -1, int other_version_id = -1);
+    bool commit();
+    // Discards the log once a checkpoint covers everything in it.
+    bool reset();
+
+    uint64_t nextLsn() const;
+    long long recordsSinceReset() const;
+};
+
+#endif
@@ -0,0 +1,14 @@
+#!/bin/bash
+set -e # Exit immediately if a command exits with a non-zero status.
+
+echo "Compiling the Time-Travelling File System benchmarks..."
+
+g++ -std=c++17 -O2 -Wall Benchmarks/DeepChainBenchmark.cpp File/File.cpp File/LineDiff.cpp Storage/SnapshotImage.cpp -o deep_chain_benchmark
+g++ -std=c++17 -O2 -Wall Benchmarks/MergeBenchmark.cpp File/LineDiff.cpp -o merge_benchmark
+g++ -std=c++17 -O2 -Wall -pthread Benchmarks/ConcurrencyBenchmark.cpp File/FileSystem.cpp File/ModificationIndex.cpp File/SearchIndex.cpp File/File.cpp File/LineDiff.cpp Storage/WriteAheadLog.cpp Storage/SnapshotImage.cpp -o concurrency_benchmark
+g++ -std=c++17 -O2 -Wall -pthread Benchmarks/LoadGenerator.cpp Server/Socket.cpp -o load_generator
+g++ -std=c++17 -O2 -Wall -pthread Benchmarks/WorkloadBenchmark.cpp File/FileSystem.cpp File/ModificationIndex.cpp File/SearchIndex.cpp File/File.cpp File/LineDiff.cpp Storage/WriteAheadLog.cpp Storage/SnapshotImage.cpp -o workload_benchmark
+g++ -std=c++17 -O2 -Wall -pthread Benchmarks/CopyBenchmark.cpp File/FileSystem.cpp File/ModificationIndex.cpp File/SearchIndex.cpp File/File.cpp File/LineDiff.cpp Storage/WriteAheadLog.cpp Storage/SnapshotImage.cpp -o copy_benchmark
+
+echo "Compilation finished. Executables 'deep_chain_benchmark', 'merge_benchmark', 'concurrency_benchmark', 'load_generator', 'workload_benchmark' and 'copy_benchmark' created."
+echo "You can run them using ./deep_chain_benchmark [depth], ./merge_benchmark [lines] [edit_every], ./concurrency_benchmark [ops_per_thread] [max_threads], ./load_generator <address> [connections] [requests] [depth], ./workload_benchmark [workload|all] [ops] [seed] and ./copy_benchmark [content_mb] [ops]"
@@ -1,9 +1,13 @@
 #!/bin/bash
 set -e # Exit immediately if a command exits with a non-zero status.
 
+# Extra compiler flags may be passed as arguments, e.g. `sh compile.sh -DTTFS_STATS`.
+
 echo "Compiling the Time-Travelling File System..."
 
-g++ -std=c++17 -Wall main.cpp File/FileSystem.cpp File/File.cpp -o filesystem
+g++ -std=c++17 -Wall -pthread main.cpp File/FileSystem.cpp File/ModificationIndex.cpp File/SearchIndex.cpp File/File.cpp File/LineDiff.cpp Storage/WriteAheadLog.cpp Storage/LogTailer.cpp Storage/SnapshotImage.cpp CLI/BatchIO.cpp CLI/CommandRunner.cpp Server/CommandServer.cpp Server/Replica.cpp Server/Socket.cpp "$@" -o filesystem
+g++ -std=c++17 -Wall Server/Client.cpp Server/Socket.cpp -o ttfs_client
 
-echo "Compilation finished. Executable 'filesystem' created."
-echo "You can run the program using ./filesystem"
+echo "Compilation finished. Executables 'filesystem' and 'ttfs_client' created."
+echo "You can run the program using ./filesystem, or serve it with ./filesystem --serve <address> and connect using ./ttfs_client <address>"
+echo "A read-only follower of a primary started with --data <directory> runs with ./filesystem --follow <directory> [--serve <address>]"
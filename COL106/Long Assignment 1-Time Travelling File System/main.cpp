@@ -1,89 +1,217 @@
 #include "File/FileSystem.hpp"
+#include "CLI/CommandRunner.hpp"
+#include "CLI/BatchIO.hpp"
+#include "Server/CommandServer.hpp"
+#include "Server/Replica.hpp"
 #include <iostream>
 #include <string>
-#include <sstream>
+#include <string_view>
 #include <vector>
+#include <cstdlib>
+#include <thread>
+#include <fstream>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <unistd.h>
 
 using namespace std;
 
-string remain_content(stringstream& ss) {
-    string content;
-    string temp;
-    if (ss >> temp) {
-        content += temp;
-        while (ss >> temp) {
-            content += " " + temp;
-        }
+// Runs every line of `path` with heap maintenance deferred and stdout going
+// through one large buffer. Errors stay unbuffered on stderr; cerr is tied to
+// cout so the buffered output of earlier commands is written out before each
+// error, and the two streams interleave in command order.
+static bool runBatch(FileSystem& fs, const string& path) {
+    InputFile input;
+    if (!input.open(path)) {
+        cerr << "Error: Could not read batch script '" << path << "'." << endl;
+        return false;
+    }
+    FdOutputBuffer output(STDOUT_FILENO);
+    cout.flush();
+    streambuf* original = cout.rdbuf(&output);
+    ostream* original_tie = cerr.tie(&cout);
+    fs.beginBatch();
+    string_view script = input.contents();
+    while (!script.empty()) {
+        size_t eol = script.find('\n');
+        string_view line = script.substr(0, eol);
+        script.remove_prefix(eol == string_view::npos ? script.size() : eol + 1);
+        runCommand(fs, line);
     }
-    return content;
+    fs.endBatch();
+    cout.flush();
+    cerr.tie(original_tie);
+    cout.rdbuf(original);
+    return true;
 }
 
-int main() {
-    FileSystem fs;
-    string line;
+// Runs a task on its own thread at a fixed interval, and once more when stopped.
+class PeriodicTask {
+private:
+    function<void()> task;
+    chrono::milliseconds interval;
+    mutex lock;
+    condition_variable wake;
+    bool stopping;
+    thread worker;
 
-    while (getline(cin, line)) {
-        stringstream ss(line);
-        string command;
-        ss >> command;
+    void loop() {
+        unique_lock<mutex> guard(lock);
+        bool last = false;
+        while (!last) {
+            last = wake.wait_for(guard, interval, [this] { return stopping; });
+            task();
+        }
+    }
 
-        if (command == "CREATE") {
-            string filename;
-            if (ss >> filename) fs.CREATE(filename);
-            else cerr << "Usage: CREATE <filename>" << endl;
-        } else if (command == "READ") {
-            string filename;
-            if (ss >> filename) fs.READ(filename);
-            else cerr << "Usage: READ <filename>" << endl;
-        } else if (command == "INSERT") {
-            string filename;
-            if (ss >> filename) {
-                string content = remain_content(ss);
-                fs.INSERT(filename, content);
-            } else {
-                cerr << "Usage: INSERT <filename> <content>" << endl;
-            }
-        } else if (command == "UPDATE") {
-            string filename;
-            if (ss >> filename) {
-                string content = remain_content(ss);
-                fs.UPDATE(filename, content);
-            } else {
-                cerr << "Usage: UPDATE <filename> <content>" << endl;
-            }
-        } else if (command == "SNAPSHOT") {
-            string filename;
-            if (ss >> filename) {
-                string message = remain_content(ss);
-                fs.SNAPSHOT(filename, message);
-            } else {
-                cerr << "Usage: SNAPSHOT <filename> <message>" << endl;
-            }
-        } else if (command == "ROLLBACK") {
-            string filename;
-            if (ss >> filename) {
-                int versionID;
-                if (ss >> versionID) fs.ROLLBACK(filename, versionID);
-                else fs.ROLLBACK(filename);
-            } else {
-                cerr << "Usage: ROLLBACK <filename>[versionID]" << endl;
+public:
+    PeriodicTask(function<void()> body, chrono::milliseconds every)
+        : task(std::move(body)), interval(every), stopping(false) {}
+    ~PeriodicTask() { stop(); }
+
+    void start() {
+        worker = thread(&PeriodicTask::loop, this);
+    }
+
+    void stop() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+};
+
+int main(int argc, char* argv[]) {
+    string data_dir;
+    string follow_dir;
+    int poll_ms = 10;
+    string batch_path;
+    string serve_address;
+    int workers = thread::hardware_concurrency() ? thread::hardware_concurrency() : 4;
+    long long gc_every = 0;
+    int keep_last = -1;
+    long long cold_age = -1;
+    int cold_depth = -1;
+    string stats_path;
+    long long stats_every = 10;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--data" && i + 1 < argc) {
+            data_dir = argv[++i];
+        } else if (arg == "--follow" && i + 1 < argc) {
+            follow_dir = argv[++i];
+        } else if (arg == "--poll-ms" && i + 1 < argc) {
+            poll_ms = atoi(argv[++i]);
+        } else if (arg == "--gc-every" && i + 1 < argc) {
+            gc_every = atoll(argv[++i]);
+        } else if (arg == "--keep-last" && i + 1 < argc) {
+            keep_last = atoi(argv[++i]);
+        } else if (arg == "--cold-age" && i + 1 < argc) {
+            cold_age = atoll(argv[++i]);
+        } else if (arg == "--cold-depth" && i + 1 < argc) {
+            cold_depth = atoi(argv[++i]);
+        } else if (arg == "--batch" && i + 1 < argc) {
+            batch_path = argv[++i];
+        } else if (arg == "--serve" && i + 1 < argc) {
+            serve_address = argv[++i];
+        } else if (arg == "--workers" && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+        } else if (arg == "--stats-file" && i + 1 < argc) {
+            stats_path = argv[++i];
+        } else if (arg == "--stats-every" && i + 1 < argc) {
+            stats_every = atoll(argv[++i]);
+        } else {
+            cerr << "Usage: " << argv[0] << " [--data <directory>] [--batch <script>] [--serve <address>] [--workers <num>]"
+                 << " [--gc-every <changes>] [--keep-last <num>] [--cold-age <seconds>] [--cold-depth <versions>]"
+                 << " [--stats-file <path>] [--stats-every <seconds>]" << endl;
+            cerr << "       " << argv[0] << " --follow <directory> [--poll-ms <ms>] [--serve <address>] [--workers <num>]" << endl;
+            return 1;
+        }
+    }
+
+    // Before the log flusher, the stats dumper or the follower start: threads
+    // inherit the mask, so the server's loop is the only taker of the signals.
+    if (!serve_address.empty()) {
+        CommandServer::blockStopSignals();
+    }
+
+    // A follower serves read-only commands from the primary's data directory,
+    // applying its log as it grows.
+    if (!follow_dir.empty()) {
+        if (!data_dir.empty() || !batch_path.empty()) {
+            cerr << "Error: --follow cannot be combined with --data or --batch." << endl;
+            return 1;
+        }
+        Replica replica(follow_dir, poll_ms);
+        if (!replica.start()) {
+            return 1;
+        }
+        if (!serve_address.empty()) {
+            CommandServer server([&replica](string_view line, ostream& out, ostream& err) {
+                replica.run(line, out, err);
+            }, workers);
+            if (!server.listen(serve_address)) {
+                return 1;
             }
-        } else if (command == "HISTORY") {
-            string filename;
-            if (ss >> filename) fs.HISTORY(filename);
-            else cerr << "Usage: HISTORY <filename>" << endl;
-        } else if (command == "RECENT_FILES") {
-            int num;
-            if (ss >> num) fs.RECENT_FILES(num);
-            else fs.RECENT_FILES(-1);
-        } else if (command == "BIGGEST_TREES") {
-            int num;
-            if (ss >> num) fs.BIGGEST_TREES(num);
-            else fs.BIGGEST_TREES(-1);
-        } else if (!command.empty()) {
-            cerr << "Error: Unknown command '" << command << "'." << endl;
+            server.run();
+            return 0;
+        }
+        string line;
+        while (getline(cin, line)) {
+            replica.run(line);
+            cout.flush();
+        }
+        return 0;
+    }
+
+    FileSystem fs;
+    if (!data_dir.empty() && !fs.openStorage(data_dir)) {
+        return 1;
+    }
+    fs.setAutoGc(gc_every, keep_last < -1 ? -1 : keep_last);
+    fs.setColdStorage(cold_age, cold_depth);
+    ofstream stats_file;
+    PeriodicTask dumper([&fs, &stats_file] {
+        fs.STATS(true, stats_file, cerr);
+        stats_file.flush();
+    }, chrono::seconds(stats_every < 1 ? 1 : stats_every));
+    if (!stats_path.empty()) {
+#ifdef TTFS_STATS
+        stats_file.open(stats_path, ios::app);
+        if (!stats_file) {
+            cerr << "Error: Could not open stats file '" << stats_path << "'." << endl;
+            return 1;
         }
+        dumper.start();
+#else
+        cerr << "Error: This build has no instrumentation; compile with -DTTFS_STATS." << endl;
+        return 1;
+#endif
     }
 
+    if (!batch_path.empty()) {
+        return runBatch(fs, batch_path) ? 0 : 1;
+    }
+    if (!serve_address.empty()) {
+        CommandServer server(fs, workers);
+        if (!server.listen(serve_address)) {
+            return 1;
+        }
+        server.run();
+        return 0;
+    }
+
+    string line;
+    while (getline(cin, line)) {
+        runCommand(fs, line);
+        STATS_ONLY(LatencyTimer flushing(fs.stageLatency(STAGE_FLUSH));)
+        cout.flush();
+    }
     return 0;
 }
@@ -0,0 +1,49 @@
+#!/bin/bash
+set -e # Exit immediately if a command exits with a non-zero status.
+
+# Checks that SIGTERM shuts a server down cleanly: a primary started with --data
+# keeps every change it acknowledged, and both it and a follower remove their
+# socket files. Run `sh compile.sh` first.
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+fail() {
+    echo "FAIL: $1"
+    exit 1
+}
+
+# Starts `./filesystem "$@"` serving on $socket and waits until it accepts.
+start_server() {
+    ./filesystem "$@" --serve "$socket" > "$work/server.out" 2>&1 &
+    server=$!
+    for _ in $(seq 1 100); do
+        [ -S "$socket" ] && return 0
+        sleep 0.05
+    done
+    fail "server on $socket did not start"
+}
+
+# Sends SIGTERM and checks that the server stopped itself.
+stop_server() {
+    kill -TERM "$server"
+    wait "$server" || fail "server exited with status $?"
+    grep -q "Server stopped." "$work/server.out" || fail "server did not shut down: $(cat "$work/server.out")"
+    [ ! -e "$socket" ] || fail "socket $socket left behind"
+}
+
+echo "Testing SIGTERM on a primary with --data..."
+socket="$work/primary.sock"
+start_server --data "$work/data"
+replies=$(printf 'CREATE a\nINSERT a hello\n' | ./ttfs_client "$socket")
+echo "$replies" | grep -q "New version 1 created" || fail "INSERT was not acknowledged: $replies"
+stop_server
+content=$(echo "READ a" | ./filesystem --data "$work/data")
+[ "$content" = "hello" ] || fail "acknowledged changes lost after SIGTERM, READ gave: $content"
+
+echo "Testing SIGTERM on a follower..."
+socket="$work/follower.sock"
+start_server --follow "$work/data"
+stop_server
+
+echo "All shutdown tests passed."